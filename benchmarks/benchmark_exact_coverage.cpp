@@ -0,0 +1,135 @@
+// Micro-benchmark for the exact-coverage density in fill_with_density(). The
+// map is a 16 x 16 mosaic of regions with wiggly outlines of 4000 vertices
+// each. Late in the integration, the weights of all regions change, but only
+// a few regions move by more than refill_displacement_tolerance. The
+// benchmark compares rasterizing all regions with an incremental refill in
+// which only the given fraction of the regions moved.
+//
+// Build and run with:
+//   cmake -B build && make -C build benchmark_exact_coverage
+//   ./build/bin/benchmark_exact_coverage
+
+#include "exact_coverage.hpp"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+
+namespace
+{
+
+struct point {
+  double x_, y_;
+  double x() const
+  {
+    return x_;
+  }
+  double y() const
+  {
+    return y_;
+  }
+};
+
+// Time in milliseconds per call of f(), averaged over n_rep calls
+template <typename F> double time_ms(const unsigned int n_rep, F f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int r = 0; r < n_rep; ++r) {
+    f();
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_rep;
+}
+
+void benchmark(const unsigned int l, const double moved_fraction)
+{
+  const unsigned int lx = l, ly = l;
+  const unsigned int n_side = 16, n_vertices = 4000, n_rep = 5;
+  const double cell = static_cast<double>(l) / n_side;
+
+  // Wiggly blobs around the centres of the mosaic tiles
+  std::vector<std::vector<point>> rings;
+  for (unsigned int a = 0; a < n_side; ++a) {
+    for (unsigned int b = 0; b < n_side; ++b) {
+      std::vector<point> ring(n_vertices);
+      for (unsigned int k = 0; k < n_vertices; ++k) {
+        const double phi = 2 * std::numbers::pi * k / n_vertices;
+        const double r = cell * (0.4 + 0.05 * std::sin(37 * phi + a + b));
+        ring[k] = {
+          (a + 0.5) * cell + r * std::cos(phi),
+          (b + 0.5) * cell + r * std::sin(phi)};
+      }
+      rings.push_back(ring);
+    }
+  }
+  const std::size_t n_regions = rings.size();
+  std::vector<double> w_num(n_regions, 1.0), w_den(n_regions, 1.0);
+  boost::multi_array<double, 2> rho_num(boost::extents[lx][ly]);
+  boost::multi_array<double, 2> rho_den(boost::extents[lx][ly]);
+  const auto add_rings = [&](ExactCoverage &coverage) {
+    return [&](const unsigned int r) {
+      coverage.add_ring(rings[r], false);
+    };
+  };
+
+  // Rasterize all regions
+  ExactCoverage full;
+  std::vector<double> vertex_shifts;
+  const double t_full = time_ms(n_rep, [&]() {
+    full.reset(lx, ly);
+    full.refill(
+      rho_num,
+      rho_den,
+      w_num,
+      w_den,
+      vertex_shifts,
+      add_rings(full));
+  });
+
+  // Change all weights and move the first n_moved regions
+  ExactCoverage incremental;
+  incremental.reset(lx, ly);
+  incremental.refill(
+    rho_num,
+    rho_den,
+    w_num,
+    w_den,
+    vertex_shifts,
+    add_rings(incremental));
+  const auto n_moved =
+    static_cast<std::size_t>(std::round(moved_fraction * n_regions));
+  const double t_incremental = time_ms(n_rep, [&]() {
+    for (std::size_t r = 0; r < n_regions; ++r) {
+      w_num[r] *= 1.01;
+      w_den[r] *= 0.99;
+      vertex_shifts[r] = (r < n_moved) ? 1e-2 : 1e-4;
+    }
+    incremental.refill(
+      rho_num,
+      rho_den,
+      w_num,
+      w_den,
+      vertex_shifts,
+      add_rings(incremental));
+  });
+  std::cout << std::setw(4) << lx << "x" << std::setw(4) << ly << std::fixed
+            << std::setprecision(1) << std::setw(9) << 100 * moved_fraction
+            << "%" << std::setprecision(3) << std::setw(12) << t_full
+            << std::setw(14) << t_incremental << std::endl;
+}
+
+}  // namespace
+
+int main()
+{
+  std::cout << "Time in ms to fill rho_num and rho_den with exact coverage\n"
+            << "     grid    moved    all regions   incremental\n";
+  for (const unsigned int l : {512u, 1024u}) {
+    for (const double moved_fraction : {0.0, 0.05, 0.25, 1.0}) {
+      benchmark(l, moved_fraction);
+    }
+  }
+  return 0;
+}
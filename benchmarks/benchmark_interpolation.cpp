@@ -0,0 +1,100 @@
+// Micro-benchmark for the bilinear interpolation in flatten_density(). It
+// compares interpolate_bilinearly() on a boost::multi_array with the scalar
+// and vectorized kernels of PaddedGrid. Every lattice point is moved by a
+// small random displacement, as in one integration step, and the velocity is
+// interpolated at the displaced points one row at a time.
+//
+// Build and run with:
+//   cmake -B build && make -C build benchmark_interpolation
+//   ./build/bin/benchmark_interpolation
+
+#include "interpolate_bilinearly.hpp"
+#include "padded_grid.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Time in milliseconds per call of f(), averaged over n_rep calls
+template <typename F> static double time_ms(const unsigned int n_rep, F f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int r = 0; r < n_rep; ++r) {
+    f();
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_rep;
+}
+
+static void benchmark(const unsigned int l)
+{
+  const unsigned int lx = l, ly = l;
+  const unsigned int n_rep = std::max(1u, (1u << 24) / (lx * ly));
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> value(-1.0, 1.0);
+  std::uniform_real_distribution<double> disp(-0.5, 0.5);
+
+  // Velocity grid
+  boost::multi_array<double, 2> grid(boost::extents[lx][ly]);
+  PaddedGrid padded;
+  padded.allocate(lx, ly, 'x');
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      grid[i][j] = value(gen);
+      padded(i, j) = grid[i][j];
+    }
+  }
+  padded.fill_ghost_cells();
+
+  // Displaced lattice points, stored row by row
+  std::vector<double> x(lx * ly), y(lx * ly), out(lx * ly);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      x[i * ly + j] = std::clamp(i + 0.5 + disp(gen), 0.0, double(lx));
+      y[i * ly + j] = std::clamp(j + 0.5 + disp(gen), 0.0, double(ly));
+    }
+  }
+  double checksum = 0.0;
+  const double t_multi_array = time_ms(n_rep, [&]() {
+    for (std::size_t k = 0; k < x.size(); ++k) {
+      out[k] = interpolate_bilinearly(x[k], y[k], grid, 'x', lx, ly);
+    }
+    checksum += out[x.size() / 2];
+  });
+  std::cout << std::setw(4) << lx << "x" << std::setw(4) << ly << std::fixed
+            << std::setprecision(3) << std::setw(12) << t_multi_array;
+
+  // PaddedGrid with every instruction set that the CPU supports
+  for (const SimdLevel level :
+       {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512}) {
+    if (level > best_simd_level()) {
+      std::cout << std::setw(12) << "-";
+      continue;
+    }
+    const double t = time_ms(n_rep, [&]() {
+      for (unsigned int i = 0; i < lx; ++i) {
+        padded.interpolate_bilinearly(
+          &x[i * ly],
+          &y[i * ly],
+          ly,
+          &out[i * ly],
+          level);
+      }
+      checksum += out[x.size() / 2];
+    });
+    std::cout << std::setw(8) << t << " (" << std::setprecision(1)
+              << t_multi_array / t << "x)" << std::setprecision(3);
+  }
+  std::cout << "  [checksum " << checksum << "]" << std::endl;
+}
+
+int main()
+{
+  std::cout << "Time in ms to interpolate at all lattice points (speed-up)\n"
+            << "     grid multi_array   scalar          AVX2           AVX-512\n";
+  for (const unsigned int l : {512u, 1024u, 2048u}) {
+    benchmark(l);
+  }
+  return 0;
+}
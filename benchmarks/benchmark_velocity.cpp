@@ -0,0 +1,119 @@
+// Micro-benchmark for the velocity evaluation in flatten_density(). It
+// compares computing the velocity on the whole lattice and interpolating it
+// with PaddedGrid (one pass over the lattice per time level) against the
+// lazy evaluation of VelocityField, which only reads the time-independent
+// planes at the four grid points around each interpolation point.
+//
+// Build and run with:
+//   cmake -B build && make -C build benchmark_velocity
+//   ./build/bin/benchmark_velocity
+
+#include "velocity_field.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Time in milliseconds per call of f(r), averaged over the calls with
+// r = 0, ..., n_rep-1
+template <typename F> static double time_ms(const unsigned int n_rep, F f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int r = 0; r < n_rep; ++r) {
+    f(r);
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_rep;
+}
+
+static void benchmark(const unsigned int l)
+{
+  const unsigned int lx = l, ly = l;
+  const unsigned int n_rep = std::max(1u, (1u << 24) / (lx * ly));
+  const double rho_mean = 1.0;
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> flux(-1.0, 1.0);
+  std::uniform_real_distribution<double> rho(0.5, 2.0);
+  std::uniform_real_distribution<double> disp(-0.5, 0.5);
+
+  // Flux and initial density
+  std::vector<double> fluxx(lx * ly), fluxy(lx * ly), rho_init(lx * ly);
+  VelocityField field;
+  field.allocate(lx, ly);
+  field.set_rho_mean(rho_mean);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      fluxx[i * ly + j] = flux(gen);
+      fluxy[i * ly + j] = flux(gen);
+      rho_init[i * ly + j] = rho(gen);
+      field.flux_x(i, j) = fluxx[i * ly + j];
+      field.flux_y(i, j) = fluxy[i * ly + j];
+      field.rho_diff(i, j) = rho_init[i * ly + j] - rho_mean;
+    }
+  }
+  field.fill_ghost_cells();
+
+  // Displaced lattice points, stored row by row
+  std::vector<double> x(lx * ly), y(lx * ly), vx(lx * ly), vy(lx * ly);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      x[i * ly + j] = std::clamp(i + 0.5 + disp(gen), 0.0, double(lx));
+      y[i * ly + j] = std::clamp(j + 0.5 + disp(gen), 0.0, double(ly));
+    }
+  }
+
+  // Every repetition uses a different time level
+  double checksum = 0.0;
+  PaddedGrid grid_vx, grid_vy;
+  grid_vx.allocate(lx, ly, 'x');
+  grid_vy.allocate(lx, ly, 'y');
+  const double t_pass = time_ms(n_rep, [&](const unsigned int r) {
+    const double t = 0.3 + r * 1e-3;
+    for (unsigned int i = 0; i < lx; ++i) {
+      for (unsigned int j = 0; j < ly; ++j) {
+        const double rho_t =
+          rho_mean + (1.0 - t) * (rho_init[i * ly + j] - rho_mean);
+        grid_vx(i, j) = -fluxx[i * ly + j] / rho_t;
+        grid_vy(i, j) = -fluxy[i * ly + j] / rho_t;
+      }
+    }
+    grid_vx.fill_ghost_cells();
+    grid_vy.fill_ghost_cells();
+    for (unsigned int i = 0; i < lx; ++i) {
+      grid_vx.interpolate_bilinearly(&x[i * ly], &y[i * ly], ly, &vx[i * ly]);
+      grid_vy.interpolate_bilinearly(&x[i * ly], &y[i * ly], ly, &vy[i * ly]);
+    }
+    checksum += vx[x.size() / 2];
+  });
+  const double t_lazy = time_ms(n_rep, [&](const unsigned int r) {
+    const double t = 0.3 + r * 1e-3;
+    for (unsigned int i = 0; i < lx; ++i) {
+      field.velocity(
+        &x[i * ly],
+        &y[i * ly],
+        ly,
+        t,
+        &vx[i * ly],
+        &vy[i * ly]);
+    }
+    checksum -= vx[x.size() / 2];
+  });
+
+  // The checksum is zero because both methods agree bit for bit
+  std::cout << std::setw(4) << lx << "x" << std::setw(4) << ly << std::fixed
+            << std::setprecision(3) << std::setw(12) << t_pass
+            << std::setw(12) << t_lazy << "  [checksum " << checksum << "]"
+            << std::endl;
+}
+
+int main()
+{
+  std::cout << "Time in ms to evaluate the velocity at all lattice points\n"
+            << "     grid   grid pass        lazy\n";
+  for (const unsigned int l : {512u, 1024u, 2048u}) {
+    benchmark(l);
+  }
+  return 0;
+}
@@ -9,7 +9,7 @@
 #include <CGAL/Min_ellipse_2_traits_2.h>
 #include <CGAL/Polygon_with_holes_2.h>
 #include <CGAL/Polyline_simplification_2/simplify.h>
-#include <CGAL/Quadtree.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
 
 typedef CGAL::Simple_cartesian<double> Scd;
 typedef CGAL::Polygon_2<Scd> Polygon;
@@ -27,12 +27,10 @@ typedef CGAL::Min_ellipse_2<Ellipse_traits> Min_ellipse;
 typedef CGAL::Min_circle_2_traits_2<Scd> Circle_traits;
 typedef CGAL::Min_circle_2<Circle_traits> Min_circle;
 
-// Quadtree
-typedef CGAL::Orthtree<CGAL::Orthtree_traits_2<Scd>, std::vector<Point>>
-  Quadtree;
-
-// Delaunay triangulation
-typedef CGAL::Delaunay_triangulation_2<Scd> Delaunay;
+// Delaunay triangulation. The info of each vertex is its projected position.
+typedef CGAL::Triangulation_vertex_base_with_info_2<Point, Scd> Delaunay_vb;
+typedef CGAL::Triangulation_data_structure_2<Delaunay_vb> Delaunay_tds;
+typedef CGAL::Delaunay_triangulation_2<Scd, Delaunay_tds> Delaunay;
 typedef Delaunay::Line_face_circulator Line_face_circulator;
 typedef Delaunay::Face_handle Face_handle;
 
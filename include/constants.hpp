@@ -24,6 +24,11 @@ constexpr double earth_surface_area = 510.1e6;
 constexpr unsigned int default_resolution = 16;
 constexpr unsigned int intersections_resolution = 1;
 
+// With exact coverage, fill_with_density() only rasterizes a GeoDiv again if
+// one of its vertices moved by more than refill_displacement_tolerance (in
+// units of grid cells) since it was last rasterized.
+constexpr double refill_displacement_tolerance = 1e-3;
+
 // Points after simplification
 constexpr unsigned int default_target_points_per_inset = 10000;
 constexpr unsigned int min_points_per_ring = 10;
@@ -0,0 +1,150 @@
+#ifndef EXACT_COVERAGE_HPP_
+#define EXACT_COVERAGE_HPP_
+
+#include <boost/multi_array.hpp>
+#include <vector>
+
+// Exact area coverage of the grid cells of an lx x ly lattice by regions
+// (e.g., GeoDivs), as in anti-aliased coverage rasterizers for fonts. In
+// each grid row that an edge of a ring crosses, the edge deposits the signed
+// area between itself and the right end of the row into an accumulation
+// array. The running sum along the row then equals the area of each grid
+// cell that is inside the ring. We store the covered area of each grid cell
+// for each region. Thus, if only the weights of the regions change, rho_num
+// and rho_den can be recomputed without rasterizing the regions again:
+// - rho_num is the sum of (w_num * covered area),
+// - rho_den is the sum of (w_den * covered area)
+// over all regions that overlap the grid cell.
+class ExactCoverage
+{
+private:
+  // Non-horizontal edge of a ring. The sign of its deposit depends on the
+  // direction of the edge and on whether the ring is an exterior ring or a
+  // hole.
+  struct signed_edge {
+    double x_lower, y_lower;  // End point with smaller y-coordinate
+    double x_upper, y_upper;  // End point with larger y-coordinate
+    double sign;
+  };
+
+  // Covered area of the grid cell with index i*ly+j
+  struct cell_area {
+    std::size_t cell;
+    double area;
+  };
+  unsigned int lx_ = 0, ly_ = 0;
+
+  // Edges of the regions that refill() rasterizes. The edges of the k-th
+  // region are in [edge_begin_[k], edge_begin_[k+1]).
+  std::vector<signed_edge> edges_;
+  std::vector<std::size_t> edge_begin_;
+
+  // Grid cells covered by each region when it was last rasterized. Grid
+  // cells whose covered area is only a rounding error are omitted.
+  std::vector<std::vector<cell_area>> coverages_;
+
+  // Add the edge from (x_prev, y_prev) to (x_curr, y_curr). orientation is
+  // +1 if the edge's ring counts positively and -1 otherwise.
+  void add_edge(
+    double x_prev,
+    double y_prev,
+    double x_curr,
+    double y_curr,
+    double orientation);
+
+  // Regions that refill() must rasterize
+  std::vector<unsigned int> regions_to_rasterize(
+    std::size_t n_regions,
+    std::vector<double> &vertex_shifts);
+
+  // Covered areas of the grid cells by the edges in [begin, end)
+  std::vector<cell_area> rasterize(std::size_t begin, std::size_t end) const;
+
+  // Rasterize the given regions, whose edges are in edges_, and sum the
+  // weighted coverages of all regions
+  void fill(
+    const std::vector<unsigned int> &regions,
+    boost::multi_array<double, 2> &rho_num,
+    boost::multi_array<double, 2> &rho_den,
+    const std::vector<double> &w_num,
+    const std::vector<double> &w_den);
+
+public:
+  // Set the lattice dimensions and remove all rasterized regions
+  void reset(unsigned int, unsigned int);
+  void free();
+  std::size_t n_regions() const
+  {
+    return coverages_.size();
+  }
+
+  // Add a ring whose vertices have the member functions x() and y() to the
+  // region that is being rasterized. The vertices must lie in
+  // [0, lx] x [0, ly]. Exterior rings count positively and holes
+  // negatively, whatever their orientation.
+  template <typename Ring> void add_ring(const Ring &, bool is_hole);
+
+  // Overwrite rho_num and rho_den with the weighted coverages of the
+  // regions. Region r has the weights w_num[r] and w_den[r].
+  // vertex_shifts[r] is an upper bound on the distance by which any vertex
+  // of region r moved since it was last rasterized. Only regions for which
+  // vertex_shifts[r] exceeds refill_displacement_tolerance are rasterized
+  // again, and their vertex_shifts[r] is set to zero. add_rings(r) must call
+  // add_ring() with the rings of region r. The first call after reset(), or
+  // after the number of regions changed, rasterizes all regions. The result
+  // does not depend on the number of threads.
+  template <typename AddRings>
+  void refill(
+    boost::multi_array<double, 2> &rho_num,
+    boost::multi_array<double, 2> &rho_den,
+    const std::vector<double> &w_num,
+    const std::vector<double> &w_den,
+    std::vector<double> &vertex_shifts,
+    const AddRings &add_rings);
+};
+
+template <typename Ring>
+void ExactCoverage::add_ring(const Ring &ring, const bool is_hole)
+{
+  // Twice the signed area, which is positive if the ring is
+  // counterclockwise
+  auto prev_point = ring[ring.size() - 1];
+  double area2 = 0.0;
+  for (const auto &curr_point : ring) {
+    area2 +=
+      prev_point.x() * curr_point.y() - curr_point.x() * prev_point.y();
+    prev_point = curr_point;
+  }
+  const double orientation = ((area2 > 0) != is_hole) ? 1.0 : -1.0;
+  for (const auto &curr_point : ring) {
+    add_edge(
+      prev_point.x(),
+      prev_point.y(),
+      curr_point.x(),
+      curr_point.y(),
+      orientation);
+    prev_point = curr_point;
+  }
+}
+
+template <typename AddRings>
+void ExactCoverage::refill(
+  boost::multi_array<double, 2> &rho_num,
+  boost::multi_array<double, 2> &rho_den,
+  const std::vector<double> &w_num,
+  const std::vector<double> &w_den,
+  std::vector<double> &vertex_shifts,
+  const AddRings &add_rings)
+{
+  const std::vector<unsigned int> regions =
+    regions_to_rasterize(w_num.size(), vertex_shifts);
+  edges_.clear();
+  edge_begin_.assign(1, 0);
+  for (const unsigned int r : regions) {
+    add_rings(r);
+    edge_begin_.push_back(edges_.size());
+  }
+  fill(regions, rho_num, rho_den, w_num, w_den);
+}
+
+#endif // EXACT_COVERAGE_HPP_
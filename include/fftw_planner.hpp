@@ -0,0 +1,26 @@
+#ifndef FFTW_PLANNER_HPP_
+#define FFTW_PLANNER_HPP_
+
+#include <fftw3.h>
+#include <string>
+
+// Process-wide FFTW settings. set_up_fftw() must be called before the first
+// FFTW plan is made, and clean_up_fftw() after the last transform.
+bool is_valid_fftw_planner(const std::string &);
+void set_up_fftw(const std::string &, const std::string &);
+unsigned int fftw_planner_flag();
+void clean_up_fftw();
+
+// Return an lx-by-ly real-to-real plan. Plans are cached per shape, kinds
+// and in-place/out-of-place layout, and they are owned by the cache. Because
+// a cached plan may have been made for other arrays, it must be executed with
+// fftw_execute_r2r() on arrays allocated with fftw_malloc().
+fftw_plan cached_fftw_plan(
+  unsigned int,
+  unsigned int,
+  double *,
+  double *,
+  fftw_r2r_kind,
+  fftw_r2r_kind);
+
+#endif // FFTW_PLANNER_HPP_
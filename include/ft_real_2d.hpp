@@ -8,7 +8,7 @@ class FTReal2d
 private:
   double *array_ = nullptr;
   unsigned int lx_ = 0, ly_ = 0;  // Lattice dimensions
-  fftw_plan plan_;
+  fftw_plan plan_ = nullptr;  // Owned by the plan cache in fftw_planner
 
 public:
   [[nodiscard]] double *as_1d_array() const;
@@ -17,7 +17,6 @@ public:
   void free();
   void make_fftw_plan(const fftw_r2r_kind &, const fftw_r2r_kind &);
   void execute_fftw_plan();
-  void destroy_fftw_plan();
 
   // Setter for array elements
   double &operator()(unsigned int, unsigned int);
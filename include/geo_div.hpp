@@ -7,7 +7,6 @@
 class GeoDiv
 {
 private:
-  std::set<std::string> adjacent_geodivs_;
   std::string id_;
   std::vector<Ellipse> min_ellipses_;
   std::vector<Polygon_with_holes> polygons_with_holes_;
@@ -15,8 +14,6 @@ private:
 
 public:
   explicit GeoDiv(std::string);
-  [[nodiscard]] const std::set<std::string> &adjacent_geodivs() const;
-  void adjacent_to(const std::string &);
   [[nodiscard]] double area() const;
   void clear_min_ellipses();
   [[nodiscard]] Bbox bbox() const;
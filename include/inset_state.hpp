@@ -2,30 +2,67 @@
 #define INSET_STATE_HPP_
 
 #include "colors.hpp"
+#include "exact_coverage.hpp"
 #include "ft_real_2d.hpp"
 #include "geo_div.hpp"
+#include "integrator.hpp"
 #include "intersection.hpp"
+#include "linear_quadtree.hpp"
+#include "point_grid.hpp"
+#include "velocity_field.hpp"
 #include <boost/multi_array.hpp>
 #include <cairo/cairo.h>
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <span>
+#include <tuple>
 
 struct max_area_error_info {
   double value;
   std::string geo_div;
 };
 
+// Convergence metrics of an inset. InsetState::set_area_errors() computes
+// them in a single pass over the GeoDivs.
+struct convergence_report {
+  max_area_error_info max_area_error{0.0, ""};
+  double area_drift = 1.0;  // Ratio of current to initial inset area
+  double mean_area_error = 0.0;
+  double rms_area_error = 0.0;
+
+  // Number of GeoDivs with area errors in [0, 0.001), [0.001, 0.01),
+  // [0.01, 0.1), [0.1, 1) and [1, infinity)
+  std::array<unsigned int, 5> area_error_histogram{};
+};
+
 struct proj_qd {  // quadtree-delaunay projection
-  Delaunay dt;
-  std::unordered_map<Point, Point> triangle_transformation;
+  Delaunay dt;  // The info of each vertex is its projected position
 };
 
 class InsetState
 {
 private:
-  std::unordered_map<std::string, double> area_errors_;
+  // Indices of the GeoDivs adjacent to each GeoDiv, in the same order as
+  // geo_divs_
+  std::vector<std::vector<unsigned int>> adjacency_;
+
+  // Area error of each GeoDiv, in the same order as geo_divs_
+  std::vector<double> area_errors_;
   std::unordered_set<Point> unique_quadtree_corners_;
   proj_qd proj_qd_;
-  std::vector<proj_qd> proj_sequence_;
+
+  // Composition of all quadtree-Delaunay projections so far. The vertices
+  // are the quadtree corners of the first integration, and their info is
+  // their current position. Empty before the first integration.
+  proj_qd cum_proj_qd_;
+
+  // Quadtree of the polygon vertices. It is updated incrementally in
+  // create_delaunay_t(), together with the triangulation in proj_qd_.
+  LinearQuadtree quadtree_;
 
   // Bounding boxes of Quadtree cells
   std::vector<Bbox> quadtree_bboxes_;
@@ -43,7 +80,7 @@ private:
   double latt_const_;
 
   // Cumulative cartogram projection
-  boost::multi_array<Point, 2> cum_proj_;
+  PointGrid cum_proj_;
   fftw_plan fwd_plan_for_rho_{};
 
   // Geographic divisions in this inset
@@ -52,9 +89,17 @@ private:
   // Copy of original data
   std::vector<GeoDiv> geo_divs_original_;
 
-  // Chosen diagonal for each grid cell
+  // Chosen diagonal for each of the (lx_ + 1) * (ly_ + 1) grid cells,
+  // including the half cells at the edges. The cell with indices [i][j] is
+  // centred at (i, j).
   boost::multi_array<int, 2> grid_diagonals_;
 
+  // The chosen diagonal splits a grid cell into two triangles. For each
+  // triangle, we store the coefficients t11, t12, t13, t21, t22 and t23 of
+  // the affine transformation that maps it onto the projected triangle.
+  boost::multi_array<std::array<std::array<double, 6>, 2>, 2>
+    triangle_transformations_;
+
   // Variable to store initial inset area before integration
   double initial_area_;
 
@@ -69,8 +114,27 @@ private:
   unsigned int lx_{}, ly_{};  // Lattice dimensions
   unsigned int n_finished_integrations_;
   std::string pos_;  // Position of inset ("C", "T" etc.)
-  boost::multi_array<Point, 2> proj_;  // Cartogram projection
-  boost::multi_array<Point, 2> identity_proj_;  // Original projection
+  PointGrid proj_;  // Cartogram projection
+  PointGrid identity_proj_;  // Original projection
+
+  // Scratch arrays of the integrator in flatten_density(). They have the
+  // same dimensions as proj_ and are allocated once per lattice. k2_, k3_
+  // and k4_ hold the stage velocities of the Bogacki-Shampine method.
+  PointGrid mid_, v_intp_;
+  PointGrid k2_, k3_, k4_;
+
+  // Time-independent planes from which the integrator evaluates the velocity
+  VelocityField velocity_field_;
+
+  // Density numerator and denominator of each grid cell from the last call
+  // of fill_with_density(). With exact coverage, exact_coverage_ stores the
+  // area of each grid cell covered by each GeoDiv when it was last
+  // rasterized, and vertex_shifts_ bounds the distance by which the vertices
+  // of each GeoDiv moved since. transform_rings() adds to vertex_shifts_.
+  // Thus, the next call only rasterizes the GeoDivs that moved again.
+  boost::multi_array<double, 2> rho_num_, rho_den_;
+  ExactCoverage exact_coverage_;
+  std::vector<double> vertex_shifts_;
 
   // Rasterized density, flux and its Fourier transform
   FTReal2d rho_ft_, rho_init_, grid_fluxx_init_, grid_fluxy_init_;
@@ -78,6 +142,40 @@ private:
 
   // Area errors
   std::vector<double> max_area_errors_;
+  convergence_report convergence_;
+
+  // Counter that is incremented whenever the coordinates of geo_divs_ or the
+  // lattice dimensions change. Cached quantities derived from the geometry
+  // store the generation for which they were computed.
+  unsigned long geometry_generation_ = 0;
+
+  // Scanlines computed by intersec_with_parallel_to(), keyed by axis,
+  // resolution and geometry generation. Entries of older generations are
+  // discarded on the next lookup.
+  mutable std::map<
+    std::tuple<char, unsigned int, unsigned long>,
+    std::vector<std::vector<intersection>>>
+    scanline_cache_;
+
+  // Area and bounding box of each GeoDiv and the total area of the inset
+  // for the geometry generation geometry_cache_generation_
+  mutable std::vector<double> geo_div_areas_;
+  mutable std::vector<Bbox> geo_div_bboxes_;
+  mutable double total_inset_area_ = 0.0;
+  mutable unsigned long geometry_cache_generation_ =
+    std::numeric_limits<unsigned long>::max();
+
+  void invalidate_geometry_caches()
+  {
+    ++geometry_generation_;
+  }
+  std::vector<std::vector<intersection>> scanlines_parallel_to(
+    char,
+    unsigned int) const;
+
+  // Recompute the cached areas and bounding boxes if the geometry changed.
+  // The first call after a change must not be inside a parallel region.
+  void update_geometry_cache() const;
 
   // Make default constructor private so that only
   // InsetState(const std::string) can be called as constructor
@@ -90,9 +188,7 @@ public:
   void apply_albers_projection();
   void apply_smyth_craster_projection();
 
-  // Calculate difference between initial area and current area
-  double area_drift() const;
-  double area_error_at(const std::string &) const;
+  double area_error_at(unsigned int) const;  // Argument is GeoDiv index
   void auto_color();  // Automatically color GeoDivs
   Bbox bbox(bool = false) const;
   void blur_density(double, bool);
@@ -103,12 +199,13 @@ public:
   bool color_found(const std::string &) const;
   bool colors_empty() const;
   unsigned int colors_size() const;
-  void create_contiguity_graph(unsigned int);
+
+  // Convergence metrics from the last call of set_area_errors()
+  const convergence_report &convergence() const;
+  void create_contiguity_graph();  // From edges shared by GeoDivs
   void create_delaunay_t();
   void densify_geo_divs();
   void densify_geo_divs_using_delaunay_t();
-  void destroy_fftw_plans_for_flux();
-  void destroy_fftw_plans_for_rho();
   void execute_fftw_bwd_plan() const;
   void execute_fftw_fwd_plan() const;
   void execute_fftw_plans_for_flux();
@@ -116,11 +213,30 @@ public:
   void fill_grid_diagonals(bool = false);
 
   // Density functions
-  void fill_with_density(bool);  // Fill map with density, using scanlines
-  void flatten_density();  // Flatten said density with integration
+  void fill_with_density(bool, bool = false);  // Fill map with density
+
+  // Add the densities of the GeoDivs, weighted by their area errors, to the
+  // numerator and denominator of each grid cell's density by sampling the
+  // GeoDivs with horizontal scanlines
+  void add_density_by_ray_sampling(
+    boost::multi_array<double, 2> &,
+    boost::multi_array<double, 2> &,
+    const std::vector<double> &) const;
+
+  // Update rho_num_ and rho_den_ with the exact area of each grid cell
+  // covered by the GeoDivs, where GeoDivs changed
+  void refill_density_by_exact_coverage(const std::vector<double> &);
+  void flatten_density(Integrator = Integrator::midpoint);  // Integration
+  void flatten_density_with_bogacki_shampine();
+  void flatten_density_with_midpoint_method();
   void flatten_ellipse_density();
   void flatten_density_with_node_vertices();
 
+  // Release all arrays whose size depends on the lattice dimensions
+  void free_grid();
+
+  double geo_div_area(unsigned int) const;  // Argument is GeoDiv index
+  Bbox geo_div_bbox(unsigned int) const;  // Argument is GeoDiv index
   const std::vector<GeoDiv> &geo_divs() const;
   std::vector<std::vector<Color>> grid_cell_colors(unsigned int cell_width);
   Polygon grid_cell_edge_points(
@@ -153,6 +269,7 @@ public:
   double initial_area() const;
   double initial_target_area() const;
   void initialize_cum_proj();
+  void initialize_flux();  // Flux of the density at t = 0
   void initialize_identity_proj();
   void insert_color(const std::string &, const Color &);
   void insert_color(const std::string &, std::string &);
@@ -162,7 +279,13 @@ public:
   std::string inset_name() const;
   nlohmann::json inset_to_geojson(bool, bool = false) const;
   std::vector<Segment> intersecting_segments(unsigned int) const;
-  std::vector<std::vector<intersection>> intersec_with_parallel_to(
+  // Scanlines for the given axis and resolution. The intersections of each
+  // ray are sorted in ascending order. Repeated calls for unchanged geometry
+  // return the cached scanlines. The returned reference points into
+  // scanline_cache_. It stays valid until the geometry changes and
+  // intersec_with_parallel_to() is called again, or until set_up_grid()
+  // clears the cache. Callers must not hold it across such calls.
+  const std::vector<std::vector<intersection>> &intersec_with_parallel_to(
     char,
     unsigned int) const;
   bool is_input_target_area_missing(const std::string &) const;
@@ -173,7 +296,6 @@ public:
   void make_fftw_plans_for_flux();
   void make_fftw_plans_for_rho();
   void min_ellipses();
-  max_area_error_info max_area_error() const;
   std::pair<double, double> max_and_min_grid_cell_area(
     unsigned int cell_width);
   std::pair<Point, Point> max_and_min_grid_cell_area_index(
@@ -187,16 +309,19 @@ public:
   std::string pos() const;
   void project();
   Point projected_point(const Point &, bool = false) const;
-  Point projected_point_with_triangulation(const Point &, bool = false) const;
+  Point projected_point_with_triangulation(const Point &) const;
   void project_with_cum_proj();
   void project_with_delaunay_t();
   void project_with_triangulation();
-  void project_with_proj_sequence();
+  void project_with_cum_proj_qd();
   void push_back(const GeoDiv &);
   FTReal2d &ref_to_fluxx_init();
   FTReal2d &ref_to_fluxy_init();
   FTReal2d &ref_to_rho_ft();
   FTReal2d &ref_to_rho_init();
+
+  // Refine the lattice by an integer factor, rescaling the map accordingly
+  void refine_grid(unsigned int);
   void remove_tiny_polygons(const double &minimum_polygon_size);
   void reset_n_finished_integrations();
   void replace_target_area(const std::string &, double);
@@ -207,6 +332,9 @@ public:
   void set_grid_dimensions(unsigned int, unsigned int);
   void set_geo_divs(std::vector<GeoDiv> new_geo_divs);
   void set_inset_name(const std::string &);
+
+  // Allocate all arrays whose size depends on the lattice dimensions
+  void set_up_grid();
   void store_initial_area();
   void store_initial_target_area();
   void simplify(unsigned int);
@@ -220,10 +348,18 @@ public:
     const std::array<Point, 3> &,
     bool = false) const;
 
-  // Apply given function to all points
-  void transform_points(const std::function<Point(Point)> &, bool = false);
-  std::array<Point, 3> untransformed_triangle(const Point &, bool = false)
-    const;
+  // Apply given function to all points. The function is a template
+  // parameter, so that it can be inlined into the loop over the points.
+  template <typename TransformPoint>
+  void transform_points(const TransformPoint &, bool = false);
+
+  // Apply given function to the vertices of each ring. The function is
+  // called with a std::span<Point> of the contiguous vertices of one ring,
+  // so that it can transform many points at once (e.g., with SIMD). If
+  // exact_coverage_ holds rasterized GeoDivs, the largest distance by which
+  // a vertex of each GeoDiv moves is added to vertex_shifts_.
+  template <typename TransformRing>
+  void transform_rings(const TransformRing &, bool = false);
   void trim_grid_heatmap(cairo_t *cr, double padding);
 
   // Cairo functions
@@ -266,4 +402,76 @@ public:
   void write_quadtree(const std::string &);
 };
 
+template <typename TransformRing>
+void InsetState::transform_rings(
+  const TransformRing &transform_ring,
+  const bool project_original)
+{
+  auto &geo_divs = project_original ? geo_divs_original_ : geo_divs_;
+  if (!project_original) {
+    invalidate_geometry_caches();
+  }
+
+  // The vertex shifts are only needed if the next call of
+  // fill_with_density() can reuse the exact coverages of GeoDivs that did
+  // not move. Otherwise, we do not pay for measuring them.
+  const bool measure_shifts =
+    !project_original && exact_coverage_.n_regions() > 0;
+  if (measure_shifts) {
+    vertex_shifts_.resize(geo_divs_.size(), 0.0);
+  }
+
+  // Iterate over GeoDivs
+#pragma omp parallel for default(none) \
+  shared(geo_divs, measure_shifts, transform_ring)
+  for (std::size_t gd = 0; gd < geo_divs.size(); ++gd) {
+
+    // Transform the ring. If the shifts are measured, the vertices are
+    // copied before the transformation, and we track the largest squared
+    // distance by which a vertex moves.
+    double max_sq_shift = 0.0;
+    const auto transform_and_measure = [&](const std::span<Point> ring) {
+      if (!measure_shifts) {
+        transform_ring(ring);
+        return;
+      }
+      thread_local std::vector<Point> old_ring;
+      old_ring.assign(ring.begin(), ring.end());
+      transform_ring(ring);
+      for (std::size_t k = 0; k < ring.size(); ++k) {
+        const double dx = ring[k].x() - old_ring[k].x();
+        const double dy = ring[k].y() - old_ring[k].y();
+        max_sq_shift = std::max(max_sq_shift, dx * dx + dy * dy);
+      }
+    };
+
+    // Iterate over Polygon_with_holes. The vertices of a CGAL::Polygon_2 are
+    // stored in a std::vector.
+    for (auto &pwh : geo_divs[gd].ref_to_polygons_with_holes()) {
+      transform_and_measure(
+        std::span<Point>(pwh.outer_boundary().container()));
+      for (auto &h : pwh.holes()) {
+        transform_and_measure(std::span<Point>(h.container()));
+      }
+    }
+    if (measure_shifts) {
+      vertex_shifts_[gd] += std::sqrt(max_sq_shift);
+    }
+  }
+}
+
+template <typename TransformPoint>
+void InsetState::transform_points(
+  const TransformPoint &transform_point,
+  const bool project_original)
+{
+  transform_rings(
+    [&transform_point](const std::span<Point> ring) {
+      for (auto &p : ring) {
+        p = transform_point(p);
+      }
+    },
+    project_original);
+}
+
 #endif // INSET_STATE_HPP_
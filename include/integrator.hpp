@@ -0,0 +1,24 @@
+#ifndef INTEGRATOR_HPP_
+#define INTEGRATOR_HPP_
+
+#include <map>
+#include <string>
+
+// Numerical integrators for the equations of motion in flatten_density()
+enum class Integrator {
+
+  // Explicit midpoint method. The difference to an Euler step serves as
+  // error estimate.
+  midpoint,
+
+  // Embedded Runge-Kutta 3(2) pair of Bogacki and Shampine with
+  // proportional-integral step-size control
+  bogacki_shampine
+};
+
+// Names accepted by the command-line option --integrator
+inline const std::map<std::string, Integrator> integrator_names = {
+  {"midpoint", Integrator::midpoint},
+  {"rk23", Integrator::bogacki_shampine}};
+
+#endif // INTEGRATOR_HPP_
@@ -3,17 +3,19 @@
 
 #include "cgal_typedef.hpp"
 
-// Struct to store intersection between line segment and grid line
+// Struct to store intersection between line segment and grid line. The
+// struct is kept small and trivially copyable because the scanline
+// algorithms create millions of intersections per integration.
 class intersection
 {
 
 private:
   double coord{};  // Coordinate in the direction of the ray
-  bool is_x{};  // Is the direction along the x-axis or y-axis?
 
 public:
-  double target_density{};  // GeoDiv's target_density
-  std::string geo_div_id;  // GeoDIv's ID
+  // Index of the GeoDiv in InsetState::geo_divs(). The index is dense, so
+  // that per-GeoDiv quantities can be looked up in flat vectors.
+  unsigned int geo_div{};
   bool ray_enters{};  // Does the ray enter (true) a GeoDiv or exit (false)?
 
   // Overloading "<" operator, similar to above
@@ -24,13 +26,9 @@ public:
       (coord == rhs.coord && ray_enters < rhs.ray_enters));
   }
 
-  // Constructors
-  explicit intersection(bool);
-  intersection();
-
   [[nodiscard]] double x() const;
   [[nodiscard]] double y() const;
-  bool ray_intersects(Point, Point, double, double, double);
+  bool ray_intersects(Point, Point, double, double, bool);
 };
 
 void add_intersections(
@@ -38,8 +36,7 @@ void add_intersections(
   const Polygon &,
   double,
   double,
-  double,
-  const std::string &,
+  unsigned int,
   char);
 
 #endif // INTERSECTION_HPP_
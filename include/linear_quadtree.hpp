@@ -0,0 +1,67 @@
+#ifndef LINEAR_QUADTREE_HPP_
+#define LINEAR_QUADTREE_HPP_
+
+#include <array>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Quadtree over a square, stored as the set of its leaves. A node is
+// identified by its locational code: the root has the code 1, and the
+// children of the node with code k have the codes 4k, ..., 4k+3. Thus, the
+// depth of a node is half the position of its leading bit, and the bits
+// below interleave the x- and y-index of the node among all nodes of the
+// same depth (Morton order). A leaf is split if and only if it contains more
+// than max_points points and its depth is less than max_depth. Because the
+// tree is only stored as a set of codes, update() can split and merge
+// leaves in place when the points move, instead of rebuilding the tree.
+class LinearQuadtree
+{
+private:
+  double x0_ = 0.0, y0_ = 0.0;  // Lower left corner of the root
+  double side_ = 0.0;  // Side length of the root
+  unsigned int max_depth_ = 0;
+  unsigned int max_points_ = 0;
+  std::unordered_set<std::uint64_t> leaves_;
+
+  // Sorted codes at depth max_depth_ of the points from the last update()
+  std::vector<std::uint64_t> point_codes_;
+
+  std::size_t n_points_in(std::uint64_t) const;
+
+public:
+  // Remove all nodes except the root and set the geometry of the root
+  void reset(
+    double x0,
+    double y0,
+    double side,
+    unsigned int max_depth,
+    unsigned int max_points);
+  void free();
+
+  // Code of the node at depth max_depth() that contains (x, y). Points on
+  // the boundary between two nodes belong to the node with the larger
+  // coordinates.
+  std::uint64_t point_code(double x, double y) const;
+
+  // Split and merge leaves so that they satisfy the splitting condition for
+  // the points with the given codes. Only leaves whose number of points
+  // crossed max_points since the last update change. Return the number of
+  // splits and merges.
+  std::size_t update(std::vector<std::uint64_t> codes);
+
+  // Leaves after refining the tree until the depths of leaves that share an
+  // edge differ by at most one, sorted by their codes
+  std::vector<std::uint64_t> graded_leaves() const;
+
+  // xmin, ymin, xmax and ymax of the node with the given code
+  std::array<double, 4> bbox(std::uint64_t) const;
+
+  static unsigned int depth(std::uint64_t);
+  unsigned int max_depth() const
+  {
+    return max_depth_;
+  }
+};
+
+#endif // LINEAR_QUADTREE_HPP_
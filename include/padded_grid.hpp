@@ -0,0 +1,102 @@
+#ifndef PADDED_GRID_HPP_
+#define PADDED_GRID_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Instruction sets for PaddedGrid::interpolate_bilinearly() on whole rows
+enum class SimdLevel { scalar, avx2, avx512 };
+
+// Best instruction set supported by the CPU we are running on
+SimdLevel best_simd_level();
+
+// Values on the grid points (i+0.5, j+0.5), with i = 0, ..., lx-1 and
+// j = 0, ..., ly-1, surrounded by one layer of ghost cells. The ghost cells
+// hold the values on the edges x = 0, x = lx, y = 0 and y = ly that are
+// implied by the boundary conditions of interpolate_bilinearly() in
+// interpolate_bilinearly.hpp. If zero == 'x', the function vanishes on the
+// edges x = 0 and x = lx, and it is continued with zero slope to the edges
+// y = 0 and y = ly. If zero == 'y', the roles of x and y are swapped.
+// If zero == 'n', the function is continued with zero slope to all four
+// edges. Because the boundary conditions are stored in the ghost cells, the
+// interpolation needs no branches. It returns the same values as
+// interpolate_bilinearly().
+class PaddedGrid
+{
+private:
+  std::vector<double> data_;
+  unsigned int lx_ = 0, ly_ = 0;  // Lattice dimensions without ghost cells
+  char zero_ = 'x';
+
+public:
+  void allocate(unsigned int, unsigned int, char);
+  void fill_ghost_cells();
+  void free()
+  {
+    data_ = {};
+  }
+
+  // Padded array, row by row, with ly+2 entries per row. The grid point
+  // (i+0.5, j+0.5) is stored at index (i+1)*(ly+2) + j+1.
+  const double *data() const
+  {
+    return data_.data();
+  }
+
+  // Setter and getter for the value at grid point (i+0.5, j+0.5)
+  double &operator()(const unsigned int i, const unsigned int j)
+  {
+    return data_[(i + 1) * (ly_ + 2) + (j + 1)];
+  }
+  double operator()(const unsigned int i, const unsigned int j) const
+  {
+    return data_[(i + 1) * (ly_ + 2) + (j + 1)];
+  }
+
+  // Interpolate at (x, y). The caller must guarantee that (x, y) lies in
+  // [0, lx] x [0, ly] and that fill_ghost_cells() was called after the last
+  // change of the grid values.
+  double interpolate_bilinearly(double, double) const;
+
+  // Interpolate at (x[k], y[k]) for k = 0, ..., n-1 and write the results to
+  // out[k]. The results do not depend on the instruction set.
+  void interpolate_bilinearly(
+    const double *x,
+    const double *y,
+    std::size_t n,
+    double *out,
+    SimdLevel = best_simd_level()) const;
+};
+
+inline double PaddedGrid::interpolate_bilinearly(
+  const double x,
+  const double y) const
+{
+  // Nearest grid lines. Index kx in the padded array stands for the grid
+  // point x0 = kx-0.5, except for kx = 0, which stands for the edge x = 0.
+  const double kx = floor(x + 0.5);
+  const double ky = floor(y + 0.5);
+
+  // The same arithmetic as in interpolate_bilinearly() so that the results
+  // are bit-identical
+  const double x0 = std::max(0.0, kx - 0.5);
+  const double x1 = std::min(static_cast<double>(lx_), kx + 0.5);
+  const double y0 = std::max(0.0, ky - 0.5);
+  const double y1 = std::min(static_cast<double>(ly_), ky + 0.5);
+  const double delta_x = (x - x0) / (x1 - x0);
+  const double delta_y = (y - y0) / (y1 - y0);
+  const std::size_t stride = ly_ + 2;
+  const double *p = data_.data() + static_cast<std::size_t>(kx) * stride +
+                    static_cast<std::size_t>(ky);
+  const double fx0y0 = p[0];
+  const double fx0y1 = p[1];
+  const double fx1y0 = p[stride];
+  const double fx1y1 = p[stride + 1];
+  return (1.0 - delta_x) * (1.0 - delta_y) * fx0y0 +
+         (1.0 - delta_x) * delta_y * fx0y1 +
+         delta_x * (1.0 - delta_y) * fx1y0 + delta_x * delta_y * fx1y1;
+}
+
+#endif // PADDED_GRID_HPP_
@@ -2,6 +2,7 @@
 #define PARSE_ARGUMENTS_HPP_
 
 #include "argparse.hpp"
+#include "integrator.hpp"
 
 // Function to parse arguments and set variables in main()
 argparse::ArgumentParser parsed_arguments(
@@ -11,6 +12,11 @@ argparse::ArgumentParser parsed_arguments(
   std::string &visual_file_name,
   unsigned int &max_n_grid_rows_or_cols,
   unsigned int &target_points_per_inset,
+  unsigned int &n_threads,
+  std::string &fftw_planner,
+  std::string &fftw_wisdom_file,
+  Integrator &integrator,
+  bool &exact_coverage,
   bool &world,
   bool &triangulation,
   bool &qtdt_method,
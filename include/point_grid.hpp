@@ -0,0 +1,133 @@
+#ifndef POINT_GRID_HPP_
+#define POINT_GRID_HPP_
+
+#include "cgal_typedef.hpp"
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocator for std::vector that aligns the array to a cache line. Rows of a
+// PointGrid then start on a vector-register boundary whenever ly is a
+// multiple of eight.
+template <typename T> struct CacheLineAllocator {
+  using value_type = T;
+  static constexpr std::align_val_t alignment{64};
+
+  CacheLineAllocator() = default;
+  template <typename U>
+  explicit CacheLineAllocator(const CacheLineAllocator<U> &) noexcept
+  {
+  }
+  T *allocate(const std::size_t n)
+  {
+    return static_cast<T *>(::operator new(n * sizeof(T), alignment));
+  }
+  void deallocate(T *p, std::size_t) noexcept
+  {
+    ::operator delete(p, alignment);
+  }
+  template <typename U> bool operator==(const CacheLineAllocator<U> &) const
+  {
+    return true;
+  }
+};
+
+// Points or vectors on the lx-times-ly lattice in structure-of-arrays layout:
+// the x-coordinates and the y-coordinates are stored in two separate planes,
+// row by row. Thus, the loops over the lattice read contiguous doubles, which
+// the compiler can vectorize, and a row can be passed directly to
+// PaddedGrid::interpolate_bilinearly().
+class PointGrid
+{
+private:
+  std::vector<double, CacheLineAllocator<double>> x_, y_;
+  unsigned int lx_ = 0, ly_ = 0;
+
+public:
+  // Resize the grid. The coordinates are left unspecified.
+  void resize(unsigned int lx, unsigned int ly)
+  {
+    lx_ = lx;
+    ly_ = ly;
+    x_.resize(static_cast<std::size_t>(lx) * ly);
+    y_.resize(static_cast<std::size_t>(lx) * ly);
+  }
+
+  // Release the memory
+  void free()
+  {
+    lx_ = 0;
+    ly_ = 0;
+    x_ = {};
+    y_ = {};
+  }
+
+  // Set the grid to the identity map, that is, (i+0.5, j+0.5) at (i, j)
+  void fill_with_lattice_points()
+  {
+#pragma omp parallel for default(none)
+    for (unsigned int i = 0; i < lx_; ++i) {
+      for (unsigned int j = 0; j < ly_; ++j) {
+        x(i, j) = i + 0.5;
+        y(i, j) = j + 0.5;
+      }
+    }
+  }
+
+  // Exchange the contents with another grid in constant time
+  void swap(PointGrid &other) noexcept
+  {
+    x_.swap(other.x_);
+    y_.swap(other.y_);
+    std::swap(lx_, other.lx_);
+    std::swap(ly_, other.ly_);
+  }
+
+  // Setters and getters for the coordinates at (i, j)
+  double &x(const unsigned int i, const unsigned int j)
+  {
+    return x_[static_cast<std::size_t>(i) * ly_ + j];
+  }
+  double x(const unsigned int i, const unsigned int j) const
+  {
+    return x_[static_cast<std::size_t>(i) * ly_ + j];
+  }
+  double &y(const unsigned int i, const unsigned int j)
+  {
+    return y_[static_cast<std::size_t>(i) * ly_ + j];
+  }
+  double y(const unsigned int i, const unsigned int j) const
+  {
+    return y_[static_cast<std::size_t>(i) * ly_ + j];
+  }
+  Point operator()(const unsigned int i, const unsigned int j) const
+  {
+    return {x(i, j), y(i, j)};
+  }
+  void set(const unsigned int i, const unsigned int j, const Point &p)
+  {
+    x(i, j) = p.x();
+    y(i, j) = p.y();
+  }
+
+  // Pointers to the first element of row i
+  double *x_row(const unsigned int i)
+  {
+    return x_.data() + static_cast<std::size_t>(i) * ly_;
+  }
+  const double *x_row(const unsigned int i) const
+  {
+    return x_.data() + static_cast<std::size_t>(i) * ly_;
+  }
+  double *y_row(const unsigned int i)
+  {
+    return y_.data() + static_cast<std::size_t>(i) * ly_;
+  }
+  const double *y_row(const unsigned int i) const
+  {
+    return y_.data() + static_cast<std::size_t>(i) * ly_;
+  }
+};
+
+#endif // POINT_GRID_HPP_
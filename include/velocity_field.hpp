@@ -0,0 +1,107 @@
+#ifndef VELOCITY_FIELD_HPP_
+#define VELOCITY_FIELD_HPP_
+
+#include "padded_grid.hpp"
+
+// Velocity field of the flow-based method,
+// v(x, y, t) = -f(x, y) / rho(x, y, t), where f is the flux and
+// rho = rho_mean + (1-t) * (rho_init - rho_mean).
+// Only the time-independent planes f_x, f_y and rho_init - rho_mean are
+// stored. The velocity is evaluated lazily at the four grid points around
+// each interpolation point and only for the time levels at which it is
+// needed. Thus, a new time level does not require a pass over the lattice.
+// The interpolated velocity is bit-identical to interpolating the velocity
+// grid computed at time t with interpolate_bilinearly().
+class VelocityField
+{
+private:
+  PaddedGrid flux_x_;  // Vanishes on the edges x = 0 and x = lx
+  PaddedGrid flux_y_;  // Vanishes on the edges y = 0 and y = ly
+  PaddedGrid rho_diff_;  // rho_init - rho_mean
+  double rho_mean_ = 0.0;
+  unsigned int lx_ = 0, ly_ = 0;
+
+public:
+  void allocate(unsigned int, unsigned int);
+  void fill_ghost_cells();
+  void free();
+  void set_rho_mean(const double rho_mean)
+  {
+    rho_mean_ = rho_mean;
+  }
+
+  // Setters for the planes at grid point (i+0.5, j+0.5). fill_ghost_cells()
+  // must be called after the last change. rho_diff(i, j) must be set to
+  // rho_init - rho_mean for the current value of rho_mean.
+  double &flux_x(const unsigned int i, const unsigned int j)
+  {
+    return flux_x_(i, j);
+  }
+  double &flux_y(const unsigned int i, const unsigned int j)
+  {
+    return flux_y_(i, j);
+  }
+  double &rho_diff(const unsigned int i, const unsigned int j)
+  {
+    return rho_diff_(i, j);
+  }
+
+  // Velocity at (x, y) and time t. The caller must guarantee that (x, y)
+  // lies in [0, lx] x [0, ly].
+  void velocity(double, double, double, double &, double &) const;
+
+  // Velocity at (x[k], y[k]) and time t for k = 0, ..., n-1. The results do
+  // not depend on the instruction set.
+  void velocity(
+    const double *x,
+    const double *y,
+    std::size_t n,
+    double t,
+    double *vx,
+    double *vy,
+    SimdLevel = best_simd_level()) const;
+};
+
+inline void VelocityField::velocity(
+  const double x,
+  const double y,
+  const double t,
+  double &vx,
+  double &vy) const
+{
+  // The same arithmetic as in PaddedGrid::interpolate_bilinearly()
+  const double kx = floor(x + 0.5);
+  const double ky = floor(y + 0.5);
+  const double x0 = std::max(0.0, kx - 0.5);
+  const double x1 = std::min(static_cast<double>(lx_), kx + 0.5);
+  const double y0 = std::max(0.0, ky - 0.5);
+  const double y1 = std::min(static_cast<double>(ly_), ky + 0.5);
+  const double delta_x = (x - x0) / (x1 - x0);
+  const double delta_y = (y - y0) / (y1 - y0);
+  const std::size_t stride = ly_ + 2;
+  const std::size_t offset =
+    static_cast<std::size_t>(kx) * stride + static_cast<std::size_t>(ky);
+  const std::size_t corner[4] = {
+    offset,
+    offset + 1,
+    offset + stride,
+    offset + stride + 1};
+
+  // Velocity at the corners (x0, y0), (x0, y1), (x1, y0) and (x1, y1)
+  const double one_minus_t = 1.0 - t;
+  double fvx[4], fvy[4];
+  for (unsigned int c = 0; c < 4; ++c) {
+    const double rho =
+      rho_mean_ + one_minus_t * rho_diff_.data()[corner[c]];
+    fvx[c] = -flux_x_.data()[corner[c]] / rho;
+    fvy[c] = -flux_y_.data()[corner[c]] / rho;
+  }
+  vx = (1.0 - delta_x) * (1.0 - delta_y) * fvx[0] +
+       (1.0 - delta_x) * delta_y * fvx[1] +
+       delta_x * (1.0 - delta_y) * fvx[2] + delta_x * delta_y * fvx[3];
+  vy = (1.0 - delta_x) * (1.0 - delta_y) * fvy[0] +
+       (1.0 - delta_x) * delta_y * fvy[1] +
+       delta_x * (1.0 - delta_y) * fvy[2] + delta_x * delta_y * fvy[3];
+}
+
+#endif // VELOCITY_FIELD_HPP_
@@ -6,16 +6,6 @@ GeoDiv::GeoDiv() = default;
 
 GeoDiv::GeoDiv(std::string i) : id_(std::move(i)) {}
 
-const std::set<std::string> &GeoDiv::adjacent_geodivs() const
-{
-  return adjacent_geodivs_;
-}
-
-void GeoDiv::adjacent_to(const std::string &id)
-{
-  adjacent_geodivs_.insert(id);
-}
-
 double GeoDiv::area() const
 {
   double a = 0.0;
@@ -123,20 +113,20 @@ Point GeoDiv::point_on_surface_of_polygon_with_holes(
   const double line_y = 0.5 * (bb.ymin() + bb.ymax());
   const double epsilon = 1e-6;
 
-  // Vector to store intersections
+  // Vector to store intersections. The GeoDiv index of the intersections is
+  // not needed here.
   std::vector<intersection> intersections;
   add_intersections(
     intersections,
     pwh.outer_boundary(),
     line_y,
-    0,
     epsilon,
-    id_,
+    0,
     'x');
 
   // Store hole intersections
   for (const auto &h : pwh.holes()) {
-    add_intersections(intersections, h, line_y, 0, epsilon, id_, 'x');
+    add_intersections(intersections, h, line_y, epsilon, 0, 'x');
   }
   std::sort(intersections.begin(), intersections.end());
 
@@ -146,26 +136,16 @@ Point GeoDiv::point_on_surface_of_polygon_with_holes(
     intersections[i].ray_enters = (i % 2 == 0);
   }
 
-  // TODO: Using target_density when we really mean line length feels like a
-  //       bad hack. should we rename the data member target_density to
-  //       value_in_geo_div?
-  // Assign length of line segments using the target_density property of
-  // intersections for line segment lengths
-  for (unsigned int i = 0; i < intersections.size(); i += 2) {
-    intersections[i].target_density =
-      intersections[i + 1].x() - intersections[i].x();
-  }
-
   // Find midpoint in maximum segment length
   double max_length = 0.0;
   double mid_x = -1.0;  // Temporary value
 
-  // Iterate over lengths
+  // Iterate over lengths of the line segments inside pwh
   for (unsigned int i = 0; i < intersections.size(); i += 2) {
-    if (intersections[i].target_density > max_length) {
-      const double left = intersections[i].x();
-      const double right = intersections[i + 1].x();
-      max_length = intersections[i].target_density;
+    const double left = intersections[i].x();
+    const double right = intersections[i + 1].x();
+    if (right - left > max_length) {
+      max_length = right - left;
       mid_x = (right + left) / 2;
     }
   }
@@ -50,6 +50,7 @@ void InsetState::adjust_for_dual_hemisphere()
         }
       }
     }
+    invalidate_geometry_caches();
   }
 }
 
@@ -111,7 +112,7 @@ void InsetState::apply_albers_projection()
 
   // Specialize/curry point_after_albers_projection() s0 that it only requires
   // one argument (Point p1).
-  std::function<Point(Point)> lambda = [=](Point p1) {
+  const auto lambda = [=](Point p1) {
     return point_after_albers_projection(p1, lambda_0, phi_0, phi_1, phi_2);
   };
 
@@ -1,7 +1,10 @@
 #include "constants.hpp"
 #include "inset_state.hpp"
 
-// Function to automatically color topology based on contiguity graph
+// Function to automatically color topology based on contiguity graph. We
+// use the smallest-last greedy coloring of Matula and Beck, which takes
+// O(V + E) time for V GeoDivs and E adjacencies. The result is
+// deterministic because it only depends on the order of geo_divs_.
 void InsetState::auto_color()
 {
   std::vector<Color> palette;
@@ -18,45 +21,76 @@ void InsetState::auto_color()
   palette.emplace_back("#b3de69");  // green
   palette.emplace_back("#fccde5");  // pink
 
-  // Find resolution
-  const unsigned int resolution = default_resolution;
+  // Create contiguity graph from the edges that GeoDivs share
+  create_contiguity_graph();
 
-  // Create continuity graph based on vertical and horizontal scanlines
-  create_contiguity_graph(resolution);
-
-  // Count colors used
-  unsigned int count = 0;
-
-  // If coloring was unsuccessful, we restrict ourselves to a smaller count.
-  // We begin by using as many colors as possible.
-  int max_i = palette.size();
-
-  // Iterate until we are able to color the entire map
-  while (colors_.size() < n_geo_divs() && max_i >= 0) {
-    for (const auto &gd : geo_divs_) {
-
-      // Iterate over all possible colors
-      for (unsigned int i = (count % max_i); i < palette.size(); ++i) {
-        const Color c = palette[i];
-        bool shared_color = false;
+  // Smallest-last ordering: repeatedly remove a GeoDiv of minimum degree
+  // from the graph. buckets[d] holds the GeoDivs of current degree d.
+  // Entries become stale when the degree of a GeoDiv decreases; they are
+  // skipped instead of being removed. Ties are broken in favour of the
+  // smaller GeoDiv index.
+  const auto n_gds = static_cast<unsigned int>(geo_divs_.size());
+  std::vector<unsigned int> degree(n_gds);
+  std::size_t max_degree = 0;
+  for (unsigned int gd = 0; gd < n_gds; ++gd) {
+    degree[gd] = static_cast<unsigned int>(adjacency_[gd].size());
+    max_degree = std::max(max_degree, adjacency_[gd].size());
+  }
+  std::vector<std::vector<unsigned int>> buckets(max_degree + 1);
+  for (unsigned int gd = n_gds; gd-- > 0;) {
+    buckets[degree[gd]].push_back(gd);
+  }
+  std::vector<bool> is_removed(n_gds, false);
+  std::vector<unsigned int> removal_order;
+  removal_order.reserve(n_gds);
 
-        // Check whether adjacent GeoDivs have the same color
-        for (const auto &gd_id : gd.adjacent_geodivs()) {
-          if (color_found(gd_id)) {
-            if (color_at(gd_id) == c) {
-              shared_color = true;
-            }
-          }
-        }
+  // The minimum degree decreases by at most one per removal. Hence, the
+  // search for the next non-empty bucket takes O(V + E) time in total.
+  unsigned int d = 0;
+  while (removal_order.size() < n_gds) {
+    while (buckets[d].empty()) {
+      ++d;
+    }
+    const unsigned int gd = buckets[d].back();
+    buckets[d].pop_back();
+    if (is_removed[gd] || degree[gd] != d) {
+      continue;
+    }
+    is_removed[gd] = true;
+    removal_order.push_back(gd);
+    for (const unsigned int adj_gd : adjacency_[gd]) {
+      if (!is_removed[adj_gd]) {
+        buckets[--degree[adj_gd]].push_back(adj_gd);
+      }
+    }
+    d = (d > 0) ? d - 1 : 0;
+  }
 
-        // Assign color if it is not shared with any adjacent GeoDiv
-        if (!shared_color) {
-          insert_color(gd.id(), c);
-          i = palette.size();
-        }
+  // Greedy coloring in reverse order of removal. When a GeoDiv is colored,
+  // at most degeneracy-many of its neighbours are colored, where the
+  // degeneracy is at most five for planar maps. Thus, the palette suffices
+  // unless the contiguity graph is far from planar. In that unlikely case,
+  // we cycle through the palette. used_by[c] == gd marks that a neighbour of
+  // gd has color c.
+  std::vector<unsigned int> color_of(n_gds);
+  std::vector<bool> is_colored(n_gds, false);
+  std::vector<unsigned int> used_by(palette.size(), n_gds);
+  for (auto it = removal_order.rbegin(); it != removal_order.rend(); ++it) {
+    const unsigned int gd = *it;
+    for (const unsigned int adj_gd : adjacency_[gd]) {
+      if (is_colored[adj_gd]) {
+        used_by[color_of[adj_gd]] = gd;
       }
-      count++;
     }
-    max_i--;
+    unsigned int c = 0;
+    while (c < palette.size() && used_by[c] == gd) {
+      ++c;
+    }
+    if (c == palette.size()) {
+      c = gd % palette.size();
+    }
+    color_of[gd] = c;
+    is_colored[gd] = true;
+    insert_color(geo_divs_[gd].id(), palette[c]);
   }
 }
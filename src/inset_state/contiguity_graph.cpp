@@ -0,0 +1,78 @@
+#include "constants.hpp"
+#include "inset_state.hpp"
+#include <boost/container_hash/hash.hpp>
+
+// Edge of a ring whose end points are rounded to multiples of
+// dbl_resolution. The end points are ordered, so that an edge shared by two
+// GeoDivs has the same key in both GeoDivs, regardless of the orientation
+// of the rings.
+struct quantized_edge {
+  long long x0, y0, x1, y1;
+  bool operator==(const quantized_edge &) const = default;
+};
+
+struct quantized_edge_hash {
+  std::size_t operator()(const quantized_edge &e) const
+  {
+    std::size_t seed = 0;
+    boost::hash_combine(seed, e.x0);
+    boost::hash_combine(seed, e.y0);
+    boost::hash_combine(seed, e.x1);
+    boost::hash_combine(seed, e.y1);
+    return seed;
+  }
+};
+
+// Creates the contiguity graph from the edges that GeoDivs have in common.
+// In a single pass over all rings, each edge is looked up in a hash table
+// that stores the first GeoDiv in which the edge occurred. Thus, the cost is
+// O(total number of points). We assume that neighbouring GeoDivs have the
+// same vertices along their common boundary. This is the case for
+// topologically consistent input, and simplify() and the densification
+// functions preserve this property.
+void InsetState::create_contiguity_graph()
+{
+  const auto quantize = [](const Point &p) {
+    return std::make_pair(
+      std::llround(p.x() / dbl_resolution),
+      std::llround(p.y() / dbl_resolution));
+  };
+  std::unordered_map<quantized_edge, unsigned int, quantized_edge_hash>
+    first_geo_div;
+  first_geo_div.reserve(n_points());
+  std::vector<std::pair<unsigned int, unsigned int>> adjacent_pairs;
+  for (unsigned int gd = 0; gd < geo_divs_.size(); ++gd) {
+    const auto add_ring = [&](const Polygon &ring) {
+      auto prev = quantize(ring[ring.size() - 1]);
+      for (const auto &pt : ring) {
+        const auto curr = quantize(pt);
+        if (curr != prev) {
+          const auto [lo, hi] = std::minmax(prev, curr);
+          const quantized_edge key{lo.first, lo.second, hi.first, hi.second};
+          const auto [it, is_new] = first_geo_div.try_emplace(key, gd);
+          if (!is_new && it->second != gd) {
+            adjacent_pairs.emplace_back(it->second, gd);
+          }
+        }
+        prev = curr;
+      }
+    };
+    for (const auto &pwh : geo_divs_[gd].polygons_with_holes()) {
+      add_ring(pwh.outer_boundary());
+      for (const auto &h : pwh.holes()) {
+        add_ring(h);
+      }
+    }
+  }
+
+  // Adjacency lists in ascending order without duplicates
+  adjacency_.assign(geo_divs_.size(), {});
+  for (const auto &[gd_1, gd_2] : adjacent_pairs) {
+    adjacency_[gd_1].push_back(gd_2);
+    adjacency_[gd_2].push_back(gd_1);
+  }
+  for (auto &adj : adjacency_) {
+    std::sort(adj.begin(), adj.end());
+    adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+  }
+}
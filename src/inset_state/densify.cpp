@@ -270,6 +270,7 @@ void InsetState::densify_geo_divs()
     geodivs_dens.push_back(gd_dens);
   }
   geo_divs_ = std::move(geodivs_dens);
+  invalidate_geometry_caches();
 }
 
 std::vector<Point> densification_points_with_delaunay_t(
@@ -453,4 +454,5 @@ void InsetState::densify_geo_divs_using_delaunay_t()
     geodivs_dens.push_back(gd_dens);
   }
   geo_divs_ = std::move(geodivs_dens);
+  invalidate_geometry_caches();
 }
@@ -1,7 +1,7 @@
 #include "constants.hpp"
 #include "inset_state.hpp"
 
-void InsetState::fill_with_density(bool plot_density)
+void InsetState::fill_with_density(bool plot_density, bool exact_coverage)
 {
   // We assume that target areas that were zero or missing in the input have
   // already been replaced by
@@ -28,15 +28,70 @@ void InsetState::fill_with_density(bool plot_density)
     }
   }
 
+  // Target density of each GeoDiv. Both rasterization methods refer to
+  // GeoDivs by their index in geo_divs_, so that the target densities and
+  // area errors can be read from flat vectors.
+  std::vector<double> target_densities(geo_divs_.size());
+  for (unsigned int gd = 0; gd < geo_divs_.size(); ++gd) {
+    target_densities[gd] =
+      target_areas_.at(geo_divs_[gd].id()) / geo_div_area(gd);
+  }
+
   // Density numerator and denominator for each grid cell. The density of
-  // a grid cell can be calculated with (rho_num / rho_den). We initially
-  // assign zero to all elements because we assume that all grid cells
-  // are outside any GeoDiv. Any grid cell where rho_den is zero will be
-  // filled with the mean_density.
+  // a grid cell can be calculated with (rho_num_ / rho_den_). Any grid cell
+  // where rho_den_ is zero is outside all GeoDivs and will be filled with
+  // the mean_density. With exact coverage, only the GeoDivs that moved since
+  // the previous call are rasterized again. The ray sampling always starts
+  // from zero in all grid cells.
+  if (exact_coverage) {
+    refill_density_by_exact_coverage(target_densities);
+  } else {
+    std::fill_n(rho_num_.data(), rho_num_.num_elements(), 0.0);
+    std::fill_n(rho_den_.data(), rho_den_.num_elements(), 0.0);
+    add_density_by_ray_sampling(rho_num_, rho_den_, target_densities);
+
+    // rho_num_ and rho_den_ no longer match the GeoDivs rasterized by
+    // exact_coverage_
+    exact_coverage_.reset(lx_, ly_);
+  }
+
+  // Fill rho_init with the ratio of rho_num_ to rho_den_
+#pragma omp parallel for default(none) shared(mean_density)
+  for (unsigned int i = 0; i < lx_; ++i) {
+    for (unsigned int j = 0; j < ly_; ++j) {
+      if (rho_den_[i][j] == 0) {
+        rho_init_(i, j) = mean_density;
+      } else {
+        rho_init_(i, j) = rho_num_[i][j] / rho_den_[i][j];
+      }
+    }
+  }
 
-  boost::multi_array<double, 2> rho_num(boost::extents[lx_][ly_]);
-  boost::multi_array<double, 2> rho_den(boost::extents[lx_][ly_]);
+  // Determine range of densities
+  auto [min_iter, max_iter] = std::minmax_element(
+    rho_init_.as_1d_array(),
+    rho_init_.as_1d_array() + lx_ * ly_);
 
+  dens_min_ = *min_iter;
+  dens_mean_ = mean_density;
+  dens_max_ = *max_iter;
+
+  if (plot_density) {
+    std::string file_name = inset_name_ + "_unblurred_density_" +
+                            std::to_string(n_finished_integrations()) + ".svg";
+
+    std::cerr << "Writing " << file_name << std::endl;
+    write_density_image(file_name, rho_init_.as_1d_array(), false);
+  }
+
+  execute_fftw_fwd_plan();
+}
+
+void InsetState::add_density_by_ray_sampling(
+  boost::multi_array<double, 2> &rho_num,
+  boost::multi_array<double, 2> &rho_den,
+  const std::vector<double> &target_densities) const
+{
   // Resolution with which we sample polygons. "resolution" is the number of
   // horizontal "test rays" between each of the ly consecutive horizontal
   // grid lines.
@@ -52,7 +107,8 @@ void InsetState::fill_with_density(bool plot_density)
           (1.0 / long_grid_length))
       : default_resolution;
 
-  auto intersections_with_rays = intersec_with_parallel_to('x', resolution);
+  const std::vector<std::vector<intersection>> &intersections_with_rays =
+    intersec_with_parallel_to('x', resolution);
 
   // Determine rho's numerator and denominator:
   // - rho_num is the sum of (weight * target_density) for each segment of a
@@ -61,20 +117,23 @@ void InsetState::fill_with_density(bool plot_density)
   // The weight of a segment of a ray that is inside a GeoDiv is equal to
   // (length of the segment inside the geo_div) * (area error of the geodiv).
 
-#pragma omp parallel for default(none) \
-  shared(intersections_with_rays, rho_den, resolution, rho_num, std::cerr)
+#pragma omp parallel for default(none) shared( \
+    intersections_with_rays,                   \
+      rho_den,                                 \
+      resolution,                              \
+      rho_num,                                 \
+      std::cerr,                               \
+      target_densities)
   for (unsigned int k = 0; k < ly_; ++k) {
 
     // Iterate over each of the rays between the grid lines y = k and
     // y = k+1
     for (double y = k + 0.5 / resolution; y < k + 1; y += 1.0 / resolution) {
 
-      // Intersections for one ray
-      auto intersections_at_y = intersections_with_rays[std::lround(
-        (y - 0.5 / resolution) * resolution)];
-
-      // Sort intersections in ascending order
-      std::sort(intersections_at_y.begin(), intersections_at_y.end());
+      // Intersections for one ray, sorted in ascending order
+      const std::vector<intersection> &intersections_at_y =
+        intersections_with_rays[std::lround(
+          (y - 0.5 / resolution) * resolution)];
 
       // If the ray has intersections, we fill any empty spaces between
       // GeoDivs. Please note that we cannot write the loop condition as:
@@ -92,10 +151,9 @@ void InsetState::fill_with_density(bool plot_density)
             // The intersections are in the same grid cell. The ray
             // enters and leaves a GeoDiv in this cell. We weigh the density
             // of the cell by the GeoDiv's area error.
-            const double weight =
-              area_error_at(intersections_at_y[i].geo_div_id) *
-              (right_x - left_x);
-            const double target_dens = intersections_at_y[i].target_density;
+            const unsigned int gd = intersections_at_y[i].geo_div;
+            const double weight = area_errors_[gd] * (right_x - left_x);
+            const double target_dens = target_densities[gd];
             const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
             rho_num[uilx][k] += weight * target_dens;
             rho_den[uilx][k] += weight;
@@ -106,11 +164,10 @@ void InsetState::fill_with_density(bool plot_density)
         // the grid cell is inside the GeoDiv
         const auto last_x =
           static_cast<unsigned int>(intersections_at_y.back().x());
+        const unsigned int last_gd = intersections_at_y.back().geo_div;
         const double last_weight =
-          area_error_at(intersections_at_y.back().geo_div_id) *
-          (last_x - floor(last_x));
-        const double last_target_density =
-          intersections_at_y.back().target_density;
+          area_errors_[last_gd] * (last_x - floor(last_x));
+        const double last_target_density = target_densities[last_gd];
         const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
         rho_num[uilx][k] += last_weight * last_target_density;
         rho_den[uilx][k] += last_weight;
@@ -146,7 +203,8 @@ void InsetState::fill_with_density(bool plot_density)
         //                   ++m) {
         // #pragma omp parallel for
         for (unsigned int m = ceil(left_x); m <= ceil(right_x); ++m) {
-          double weight = area_error_at(intersections_at_y[i].geo_div_id);
+          const unsigned int gd = intersections_at_y[i].geo_div;
+          double weight = area_errors_[gd];
           if (ceil(left_x) == ceil(right_x)) {
             weight *= (right_x - left_x);
           } else if (m == ceil(left_x)) {
@@ -154,42 +212,42 @@ void InsetState::fill_with_density(bool plot_density)
           } else if (m == ceil(right_x)) {
             weight *= (right_x - floor(right_x));
           }
-          const double target_dens = intersections_at_y[i].target_density;
+          const double target_dens = target_densities[gd];
           rho_num[m - 1][k] += weight * target_dens;
           rho_den[m - 1][k] += weight;
         }
       }
     }
   }
+}
 
-  // Fill rho_init with the ratio of rho_num to rho_den
-#pragma omp parallel for default(none) shared(mean_density, rho_den, rho_num)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      if (rho_den[i][j] == 0) {
-        rho_init_(i, j) = mean_density;
-      } else {
-        rho_init_(i, j) = rho_num[i][j] / rho_den[i][j];
-      }
-    }
-  }
-
-  // Determine range of densities
-  auto [min_iter, max_iter] = std::minmax_element(
-    rho_init_.as_1d_array(),
-    rho_init_.as_1d_array() + lx_ * ly_);
-
-  dens_min_ = *min_iter;
-  dens_mean_ = mean_density;
-  dens_max_ = *max_iter;
-
-  if (plot_density) {
-    std::string file_name = inset_name_ + "_unblurred_density_" +
-                            std::to_string(n_finished_integrations()) + ".svg";
-
-    std::cerr << "Writing " << file_name << std::endl;
-    write_density_image(file_name, rho_init_.as_1d_array(), false);
+// Incremental refill of rho_num_ and rho_den_ with exact coverage (see
+// exact_coverage.hpp). Late in the integration, most GeoDivs barely move
+// between two calls. Their stored coverages are only weighted again, which
+// is much cheaper than rasterizing them. The weights of a GeoDiv are
+// - w_num = area error * target density,
+// - w_den = area error.
+void InsetState::refill_density_by_exact_coverage(
+  const std::vector<double> &target_densities)
+{
+  std::vector<double> w_num(geo_divs_.size());
+  std::vector<double> w_den(geo_divs_.size());
+  for (unsigned int gd = 0; gd < geo_divs_.size(); ++gd) {
+    w_den[gd] = area_errors_[gd];
+    w_num[gd] = w_den[gd] * target_densities[gd];
   }
-
-  execute_fftw_fwd_plan();
+  exact_coverage_.refill(
+    rho_num_,
+    rho_den_,
+    w_num,
+    w_den,
+    vertex_shifts_,
+    [this](const unsigned int gd) {
+      for (const auto &pwh : geo_divs_[gd].polygons_with_holes()) {
+        exact_coverage_.add_ring(pwh.outer_boundary(), false);
+        for (const auto &h : pwh.holes()) {
+          exact_coverage_.add_ring(h, true);
+        }
+      }
+    });
 }
@@ -1,107 +1,12 @@
 #include "constants.hpp"
 #include "inset_state.hpp"
-#include "interpolate_bilinearly.hpp"
-
-// Function to calculate the velocity at the grid points (x, y) with x =
-// 0.5, 1.5, ..., lx-0.5 and y = 0.5, 1.5, ..., ly-0.5 at time t
-void calculate_velocity(
-  double t,
-  const FTReal2d &grid_fluxx_init,
-  const FTReal2d &grid_fluxy_init,
-  const FTReal2d &rho_ft,
-  const FTReal2d &rho_init,
-  boost::multi_array<double, 2> &grid_vx,
-  boost::multi_array<double, 2> &grid_vy,
-  const unsigned int lx,
-  const unsigned int ly)
-{
-#pragma omp parallel for default(none) shared( \
-    grid_fluxx_init,                           \
-      grid_fluxy_init,                         \
-      grid_vx,                                 \
-      grid_vy,                                 \
-      lx,                                      \
-      ly,                                      \
-      rho_ft,                                  \
-      rho_init,                                \
-      t)
-  for (unsigned int i = 0; i < lx; ++i) {
-    for (unsigned int j = 0; j < ly; ++j) {
-      double rho = rho_ft(0, 0) + (1.0 - t) * (rho_init(i, j) - rho_ft(0, 0));
-      grid_vx[i][j] = -grid_fluxx_init(i, j) / rho;
-      grid_vy[i][j] = -grid_fluxy_init(i, j) / rho;
-    }
-  }
-}
-
-bool all_points_are_in_domain(
-  double delta_t,
-  const boost::multi_array<Point, 2> &proj,
-  const boost::multi_array<Vector, 2> &v_intp,
-  const unsigned int lx,
-  const unsigned int ly)
-{
-  // Return false if and only if there exists a point that would be outside
-  // [0, lx] x [0, ly]
-  bool in_domain = true;
-
-#pragma omp parallel for reduction(&& : in_domain) default(none) \
-  shared(delta_t, proj, v_intp, lx, ly)
-  for (unsigned int i = 0; i < lx; ++i) {
-    for (unsigned int j = 0; j < ly; ++j) {
-      double x = (proj)[i][j].x() + 0.5 * delta_t * (v_intp)[i][j].x();
-      double y = (proj)[i][j].y() + 0.5 * delta_t * (v_intp)[i][j].y();
-      if (x < 0.0 || x > lx || y < 0.0 || y > ly) {
-        in_domain = false;
-      }
-    }
-  }
-  return in_domain;
-}
+#include <atomic>
 
-// Function to integrate the equations of motion with the fast flow-based
-// method
-void InsetState::flatten_density()
+// Compute the flux vector at t = 0 and store the result in grid_fluxx_init_
+// and grid_fluxy_init_. The time-independent planes of the velocity field
+// are set up from the flux and the initial density.
+void InsetState::initialize_flux()
 {
-  // Constants for the numerical integrator
-  const double inc_after_acc = 1.1;
-  const double dec_after_not_acc = 0.75;
-  const double abs_tol = (std::min(lx_, ly_) * 1e-6);
-
-  // Resize proj_ multi-array if running for the first time
-  if (proj_.shape()[0] != lx_ || proj_.shape()[1] != ly_) {
-    proj_.resize(boost::extents[lx_][ly_]);
-  }
-
-#pragma omp parallel for default(none) shared(proj_)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      proj_[i][j] = Point(i + 0.5, j + 0.5);
-    }
-  }
-
-  // Allocate memory for the velocity grid
-  boost::multi_array<double, 2> grid_vx(boost::extents[lx_][ly_]);
-  boost::multi_array<double, 2> grid_vy(boost::extents[lx_][ly_]);
-
-  // eul[i][j] will be the new position of proj_[i][j] proposed by a simple
-  // Euler step: move a full time interval delta_t with the velocity at time t
-  // and position (proj_[i][j].x, proj_[i][j].y)
-  boost::multi_array<Point, 2> eul(boost::extents[lx_][ly_]);
-
-  // mid[i][j] will be the new displacement proposed by the midpoint
-  // method (see comment below for the formula)
-  boost::multi_array<Point, 2> mid(boost::extents[lx_][ly_]);
-
-  // (vx_intp, vy_intp) will be the velocity at position (proj_.x, proj_.y) at
-  // time t
-  boost::multi_array<Vector, 2> v_intp(boost::extents[lx_][ly_]);
-
-  // (vx_intp_half, vy_intp_half) will be the velocity at the midpoint
-  // (proj_.x + 0.5*delta_t*vx_intp, proj_.y + 0.5*delta_t*vy_intp) at time
-  // t + 0.5*delta_t
-  boost::multi_array<Vector, 2> v_intp_half(boost::extents[lx_][ly_]);
-
   // Initialize the Fourier transforms of gridvx[] and gridvy[] at
   // every point on the lx_-times-ly_ grid at t = 0. We must typecast lx_ and
   // ly_ as double-precision numbers. Otherwise, the ratios in the denominator
@@ -142,131 +47,180 @@ void InsetState::flatten_density()
   // grid_fluxy_init
   execute_fftw_plans_for_flux();
 
+  // The density at time t is rho_mean + (1-t) * (rho_init - rho_mean),
+  // where rho_mean = rho_ft_(0, 0)
+  const double rho_mean = rho_ft_(0, 0);
+  velocity_field_.set_rho_mean(rho_mean);
+
+#pragma omp parallel for default(none) shared(rho_mean)
+  for (unsigned int i = 0; i < lx_; ++i) {
+    for (unsigned int j = 0; j < ly_; ++j) {
+      velocity_field_.flux_x(i, j) = grid_fluxx_init_(i, j);
+      velocity_field_.flux_y(i, j) = grid_fluxy_init_(i, j);
+      velocity_field_.rho_diff(i, j) = rho_init_(i, j) - rho_mean;
+    }
+  }
+  velocity_field_.fill_ghost_cells();
+}
+
+// Function to integrate the equations of motion with the fast flow-based
+// method
+void InsetState::flatten_density(const Integrator integrator)
+{
+  proj_.fill_with_lattice_points();
+  initialize_flux();
+  if (integrator == Integrator::bogacki_shampine) {
+    flatten_density_with_bogacki_shampine();
+  } else {
+    flatten_density_with_midpoint_method();
+  }
+}
+
+// Explicit midpoint method. The difference between the midpoint and the Euler
+// proposals serves as error estimate.
+void InsetState::flatten_density_with_midpoint_method()
+{
+  // Constants for the numerical integrator
+  const double inc_after_acc = 1.1;
+  const double dec_after_not_acc = 0.75;
+  const double abs_tol = (std::min(lx_, ly_) * 1e-6);
+
+  // The integration step is performed in a single pass over tiles of
+  // tile_width consecutive lattice points in a row. All intermediate results
+  // of a tile (the Euler proposal, the midpoint and the velocity at the
+  // midpoint) stay in small per-thread buffers that fit into the L1 cache.
+  // Only the following arrays span the whole lattice. They are members so
+  // that set_up_grid() allocates them once per lattice.
+  // - v_intp_(i, j) is the velocity at position proj_(i, j) at time t. It is
+  //   computed the first time a tile is visited at a time level and reused
+  //   if the step is retried with a smaller delta_t.
+  // - mid_(i, j) is the new position of proj_(i, j) proposed by the midpoint
+  //   method (see comment below for the formula).
+  constexpr unsigned int tile_width = 256;
+  const unsigned int tiles_per_row = (ly_ + tile_width - 1) / tile_width;
+  const unsigned int n_tiles = lx_ * tiles_per_row;
+  std::vector<unsigned char> tile_has_v_intp(n_tiles);
+
+  // Integration step from t to t + delta_t on one tile. Return false as
+  // soon as the tile rejects the step.
+  auto midpoint_step_on_tile = [&](
+                                 const unsigned int tile,
+                                 const double t,
+                                 const double delta_t,
+                                 double *eul_x,
+                                 double *eul_y,
+                                 double *v_half_x,
+                                 double *v_half_y) {
+    const unsigned int i = tile / tiles_per_row;
+    const unsigned int j0 = (tile % tiles_per_row) * tile_width;
+    const unsigned int n = std::min(tile_width, ly_ - j0);
+    const double *px = proj_.x_row(i) + j0;
+    const double *py = proj_.y_row(i) + j0;
+    double *vx = v_intp_.x_row(i) + j0;
+    double *vy = v_intp_.y_row(i) + j0;
+    double *mx = mid_.x_row(i) + j0;
+    double *my = mid_.y_row(i) + j0;
+
+    // We know, either because of the initialization or because of the check
+    // at the end of the last iteration, that proj_(i, j) is inside the
+    // rectangle [0, lx_] x [0, ly_]. This fact guarantees that velocity() is
+    // given a point that cannot cause it to fail.
+    if (!tile_has_v_intp[tile]) {
+      velocity_field_.velocity(px, py, n, t, vx, vy);
+      tile_has_v_intp[tile] = 1;
+    }
+
+    // Simple Euler step and midpoint. The midpoints are stored temporarily
+    // in mid_, which is overwritten with the new positions below. Reject the
+    // step if a midpoint is outside [0, lx_] x [0, ly_] because we must not
+    // pass it to velocity().
+    for (unsigned int k = 0; k < n; ++k) {
+      eul_x[k] = px[k] + vx[k] * delta_t;
+      eul_y[k] = py[k] + vy[k] * delta_t;
+      mx[k] = px[k] + 0.5 * delta_t * vx[k];
+      my[k] = py[k] + 0.5 * delta_t * vy[k];
+      if (mx[k] < 0.0 || mx[k] > lx_ || my[k] < 0.0 || my[k] > ly_) {
+        return false;
+      }
+    }
+
+    // Use "explicit midpoint method"
+    // x <- x + delta_t * v_x(x + 0.5*delta_t*v_x(x,y,t),
+    //                        y + 0.5*delta_t*v_y(x,y,t),
+    //                        t + 0.5*delta_t)
+    // and similarly for y.
+    velocity_field_
+      .velocity(mx, my, n, t + 0.5 * delta_t, v_half_x, v_half_y);
+    for (unsigned int k = 0; k < n; ++k) {
+      mx[k] = px[k] + v_half_x[k] * delta_t;
+      my[k] = py[k] + v_half_y[k] * delta_t;
+
+      // Do not accept the integration step if the maximum squared difference
+      // between the Euler and midpoint proposals exceeds abs_tol. Neither
+      // should we accept the integration step if one of the positions
+      // wandered out of the domain.
+      const double dx = mx[k] - eul_x[k];
+      const double dy = my[k] - eul_y[k];
+      const double sq_dist = dx * dx + dy * dy;
+      if (
+        sq_dist > abs_tol || mx[k] < 0.0 || mx[k] > lx_ || my[k] < 0.0 ||
+        my[k] > ly_) {
+        return false;
+      }
+    }
+    return true;
+  };
+
   double t = 0.0;
   double delta_t = 1e-2;  // Initial time step.
   unsigned int iter = 0;
   const unsigned int max_iter = 300;
+  unsigned int n_rejected_steps = 0;
+  unsigned int n_velocity_evaluations = 0;
 
   // Integrate
   while (t < 1.0 && iter <= max_iter) {
-    calculate_velocity(
-      t,
-      grid_fluxx_init_,
-      grid_fluxy_init_,
-      rho_ft_,
-      rho_init_,
-      grid_vx,
-      grid_vy,
-      lx_,
-      ly_);
-#pragma omp parallel for default(none) shared(proj_, v_intp, grid_vx, grid_vy)
-    for (unsigned int i = 0; i < lx_; ++i) {
-      for (unsigned int j = 0; j < ly_; ++j) {
-        // We know, either because of the initialization or because of the
-        // check at the end of the last iteration, that (proj_.x, proj_.y)
-        // is inside the rectangle [0, lx_] x [0, ly_]. This fact guarantees
-        // that interpolate_bilinearly() is given a point that cannot cause it
-        // to fail.
-        double vx = interpolate_bilinearly(
-          proj_[i][j].x(),
-          proj_[i][j].y(),
-          grid_vx,
-          'x',
-          lx_,
-          ly_);
-        double vy = interpolate_bilinearly(
-          proj_[i][j].x(),
-          proj_[i][j].y(),
-          grid_vy,
-          'y',
-          lx_,
-          ly_);
-        v_intp[i][j] = Vector(vx, vy);
-      }
-    }
 
+    // The velocity at time t is evaluated once per time level, and the
+    // velocity at time t + 0.5*delta_t once per attempted step
+    ++n_velocity_evaluations;
+    std::fill(tile_has_v_intp.begin(), tile_has_v_intp.end(), 0);
     bool accept = false;
     while (!accept) {
-// Simple Euler step
-#pragma omp parallel for default(none) shared(proj_, v_intp, delta_t, eul)
-      for (unsigned int i = 0; i < lx_; ++i) {
-        for (unsigned int j = 0; j < ly_; ++j) {
-          eul[i][j] = Point(
-            proj_[i][j].x() + v_intp[i][j].x() * delta_t,
-            proj_[i][j].y() + v_intp[i][j].y() * delta_t);
-        }
-      }
-
-      // Use "explicit midpoint method"
-      // x <- x + delta_t * v_x(x + 0.5*delta_t*v_x(x,y,t),
-      //                        y + 0.5*delta_t*v_y(x,y,t),
-      //                        t + 0.5*delta_t)
-      // and similarly for y.
-      calculate_velocity(
-        t + 0.5 * delta_t,
-        grid_fluxx_init_,
-        grid_fluxy_init_,
-        rho_ft_,
-        rho_init_,
-        grid_vx,
-        grid_vy,
-        lx_,
-        ly_);
-
-      // Make sure we do not pass a point outside [0, lx_] x [0, ly_] to
-      // interpolate_bilinearly(). Otherwise, decrease the time step below and
-      // try again.
-      accept = all_points_are_in_domain(delta_t, proj_, v_intp, lx_, ly_);
-      if (accept) {
-        // Okay, we can run interpolate_bilinearly()
-#pragma omp parallel for default(none) shared( \
-    abs_tol,                                   \
-      accept,                                  \
-      delta_t,                                 \
-      eul,                                     \
-      grid_vx,                                 \
-      grid_vy,                                 \
-      mid,                                     \
-      v_intp,                                  \
-      v_intp_half)
-        for (unsigned int i = 0; i < lx_; ++i) {
-          for (unsigned int j = 0; j < ly_; ++j) {
-            double vx_half = interpolate_bilinearly(
-              proj_[i][j].x() + 0.5 * delta_t * v_intp[i][j].x(),
-              proj_[i][j].y() + 0.5 * delta_t * v_intp[i][j].y(),
-              grid_vx,
-              'x',
-              lx_,
-              ly_);
-            double vy_half = interpolate_bilinearly(
-              proj_[i][j].x() + 0.5 * delta_t * v_intp[i][j].x(),
-              proj_[i][j].y() + 0.5 * delta_t * v_intp[i][j].y(),
-              grid_vy,
-              'y',
-              lx_,
-              ly_);
-            v_intp_half[i][j] = Vector(vx_half, vy_half);
-            mid[i][j] = Point(
-              proj_[i][j].x() + v_intp_half[i][j].x() * delta_t,
-              proj_[i][j].y() + v_intp_half[i][j].y() * delta_t);
-
-            // Do not accept the integration step if the maximum squared
-            // difference between the Euler and midpoint proposals exceeds
-            // abs_tol. Neither should we accept the integration step if one
-            // of the positions wandered out of the domain. If one of these
-            // problems occurred, decrease the time step.
-            double sq_dist = CGAL::squared_distance(mid[i][j], eul[i][j]);
-            if (
-              sq_dist > abs_tol || mid[i][j].x() < 0.0 ||
-              mid[i][j].x() > lx_ || mid[i][j].y() < 0.0 ||
-              mid[i][j].y() > ly_) {
-              accept = false;
-            }
+      ++n_velocity_evaluations;
+
+      // The step is accepted if and only if all tiles accept it. As soon as
+      // one tile rejects the step, the remaining tiles are skipped. The
+      // result does not depend on the order in which the tiles are visited.
+      std::atomic<bool> reject = false;
+
+#pragma omp parallel default(none) \
+  shared(delta_t, midpoint_step_on_tile, n_tiles, reject, t)
+      {
+        std::vector<double> eul_x(tile_width), eul_y(tile_width);
+        std::vector<double> v_half_x(tile_width), v_half_y(tile_width);
+
+#pragma omp for schedule(dynamic)
+        for (unsigned int tile = 0; tile < n_tiles; ++tile) {
+          if (reject.load(std::memory_order_relaxed)) {
+            continue;
+          }
+          if (!midpoint_step_on_tile(
+                tile,
+                t,
+                delta_t,
+                eul_x.data(),
+                eul_y.data(),
+                v_half_x.data(),
+                v_half_y.data())) {
+            reject.store(true, std::memory_order_relaxed);
           }
         }
       }
+      accept = !reject;
       if (!accept) {
         delta_t *= dec_after_not_acc;
+        ++n_rejected_steps;
       }
     }
 
@@ -279,50 +233,227 @@ void InsetState::flatten_density()
     // When we get here, the integration step was accepted
     t += delta_t;
     ++iter;
-    proj_ = mid;
+    proj_.swap(mid_);
     delta_t *= inc_after_acc;  // Try a larger step next time
   }
+  std::cerr << "Midpoint method: " << iter << " steps, " << n_rejected_steps
+            << " rejected steps, " << n_velocity_evaluations
+            << " velocity evaluations" << std::endl;
 }
 
-bool all_map_points_are_in_domain(
+// Set pos = proj + h * (c1*k1 + c2*k2 + c3*k3), where k1, k2 and k3 are
+// velocities. Return false if and only if one of the new positions is
+// outside [0, lx] x [0, ly].
+static bool runge_kutta_stage(
+  const PointGrid &proj,
+  const double h,
+  const double c1,
+  const PointGrid &k1,
+  const double c2,
+  const PointGrid &k2,
+  const double c3,
+  const PointGrid &k3,
+  PointGrid &pos,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  bool in_domain = true;
+
+#pragma omp parallel for reduction(&& : in_domain) default(none) \
+  shared(proj, h, c1, k1, c2, k2, c3, k3, pos, lx, ly)
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      const double x =
+        proj.x(i, j) + h * (c1 * k1.x(i, j) + c2 * k2.x(i, j) +
+                            c3 * k3.x(i, j));
+      const double y =
+        proj.y(i, j) + h * (c1 * k1.y(i, j) + c2 * k2.y(i, j) +
+                            c3 * k3.y(i, j));
+      pos.x(i, j) = x;
+      pos.y(i, j) = y;
+      if (x < 0.0 || x > lx || y < 0.0 || y > ly) {
+        in_domain = false;
+      }
+    }
+  }
+  return in_domain;
+}
+
+// Embedded Runge-Kutta 3(2) pair of Bogacki and Shampine (1989). The
+// difference between the third-order and the second-order solutions serves
+// as error estimate. The step size is adapted with a proportional-integral
+// (PI) controller, which avoids the oscillating step sizes of a pure
+// proportional controller (see Hairer & Wanner, Solving Ordinary
+// Differential Equations II, Sect. IV.2). The last stage of a step is the
+// first stage of the next step (first same as last), so that an accepted
+// step costs three evaluations of the velocity field.
+void InsetState::flatten_density_with_bogacki_shampine()
+{
+  // As for the midpoint method, the tolerance applies to squared distances
+  const double abs_tol = (std::min(lx_, ly_) * 1e-6);
+
+  // Parameters of the PI controller. The exponents are 0.7/(q+1) and
+  // 0.4/(q+1), where q = 2 is the order of the error estimate.
+  const double safety = 0.9;
+  const double alpha = 0.7 / 3.0;
+  const double beta = 0.4 / 3.0;
+  const double min_factor = 0.2;
+  const double max_factor = 5.0;
+  const unsigned int max_iter = 300;
+
+  // Velocities at the stages. The first stage is stored in v_intp_. The
+  // positions of the stages and, finally, the new positions are stored in
+  // mid_.
+  PointGrid &k1 = v_intp_;
+  PointGrid &k2 = k2_;
+  PointGrid &k3 = k3_;
+  PointGrid &k4 = k4_;
+  unsigned int n_velocity_evaluations = 0;
+
+  // Velocity at time t_stage at the positions pos. All positions must be
+  // inside [0, lx_] x [0, ly_].
+  auto velocity_at_stage = [&](
+                             const double t_stage,
+                             const PointGrid &pos,
+                             PointGrid &k) {
+    ++n_velocity_evaluations;
+#pragma omp parallel for default(none) shared(t_stage, pos, k)
+    for (unsigned int i = 0; i < lx_; ++i) {
+      velocity_field_.velocity(
+        pos.x_row(i),
+        pos.y_row(i),
+        ly_,
+        t_stage,
+        k.x_row(i),
+        k.y_row(i));
+    }
+  };
+  double t = 0.0;
+  double delta_t = 1e-2;  // Initial time step
+  double prev_err = 1.0;  // Error ratio of the previous accepted step
+  unsigned int iter = 0;
+  unsigned int n_rejected_steps = 0;
+  velocity_at_stage(0.0, proj_, k1);
+
+  // Integrate
+  while (t < 1.0 && iter <= max_iter) {
+
+    // Do not step beyond t = 1, where the density is flat
+    delta_t = std::min(delta_t, 1.0 - t);
+
+    // Stages 2 and 3 and the third-order solution. The velocity is only
+    // interpolated at positions inside [0, lx_] x [0, ly_].
+    bool in_domain = runge_kutta_stage(
+      proj_, delta_t, 0.5, k1, 0.0, k1, 0.0, k1, mid_, lx_, ly_);
+    if (in_domain) {
+      velocity_at_stage(t + 0.5 * delta_t, mid_, k2);
+      in_domain = runge_kutta_stage(
+        proj_, delta_t, 0.0, k1, 0.75, k2, 0.0, k2, mid_, lx_, ly_);
+    }
+    if (in_domain) {
+      velocity_at_stage(t + 0.75 * delta_t, mid_, k3);
+      in_domain = runge_kutta_stage(
+        proj_,
+        delta_t,
+        2.0 / 9.0,
+        k1,
+        1.0 / 3.0,
+        k2,
+        4.0 / 9.0,
+        k3,
+        mid_,
+        lx_,
+        ly_);
+    }
+    if (!in_domain) {
+      delta_t *= 0.5;
+      ++n_rejected_steps;
+      continue;
+    }
+
+    // Stage 4 at the new positions. The difference between the third-order
+    // and second-order solutions is
+    // delta_t * (-5/72 k1 + 1/12 k2 + 1/9 k3 - 1/8 k4).
+    velocity_at_stage(t + delta_t, mid_, k4);
+    double max_sq_err = 0.0;
+
+#pragma omp parallel for reduction(max : max_sq_err) default(none) \
+  shared(delta_t, k1, k2, k3, k4)
+    for (unsigned int i = 0; i < lx_; ++i) {
+      for (unsigned int j = 0; j < ly_; ++j) {
+        const double err_x =
+          delta_t * (-5.0 / 72.0 * k1.x(i, j) + 1.0 / 12.0 * k2.x(i, j) +
+                     1.0 / 9.0 * k3.x(i, j) - 1.0 / 8.0 * k4.x(i, j));
+        const double err_y =
+          delta_t * (-5.0 / 72.0 * k1.y(i, j) + 1.0 / 12.0 * k2.y(i, j) +
+                     1.0 / 9.0 * k3.y(i, j) - 1.0 / 8.0 * k4.y(i, j));
+        max_sq_err = std::max(max_sq_err, err_x * err_x + err_y * err_y);
+      }
+    }
+
+    // Error ratio. The step is accepted if err <= 1.
+    const double err = std::sqrt(max_sq_err / abs_tol);
+    if (err > 1.0) {
+      delta_t *= std::max(min_factor, safety * std::pow(err, -1.0 / 3.0));
+      ++n_rejected_steps;
+      continue;
+    }
+
+    // Control output
+    if (iter % 10 == 0) {
+      std::cerr << "iter = " << iter << ", t = " << t
+                << ", delta_t = " << delta_t << "\n";
+    }
+
+    // When we get here, the integration step was accepted. The velocity at
+    // the new positions becomes the first stage of the next step.
+    t += delta_t;
+    ++iter;
+    proj_.swap(mid_);
+    k1.swap(k4);
+    double factor = max_factor;
+    if (err > 0.0) {
+      factor = std::clamp(
+        safety * std::pow(err, -alpha) * std::pow(prev_err, beta),
+        min_factor,
+        max_factor);
+    }
+    prev_err = std::max(err, 1e-4);
+    delta_t *= factor;
+  }
+  std::cerr << "Bogacki-Shampine method: " << iter << " steps, "
+            << n_rejected_steps << " rejected steps, "
+            << n_velocity_evaluations << " velocity evaluations" << std::endl;
+}
+
+bool all_corners_are_in_domain(
   const double delta_t,
-  const std::unordered_map<Point, Point> &proj_map,
-  const std::unordered_map<Point, Vector> &v_intp,
+  const std::vector<Point> &proj,
+  const std::vector<Vector> &v_intp,
   const unsigned int lx,
   const unsigned int ly)
 {
   // Return false if and only if there exists a point that would be outside
   // [0, lx] x [0, ly]
-  for (const auto &[key, val] : proj_map) {
-    double x = val.x() + 0.5 * delta_t * v_intp.at(key).x();
-    double y = val.y() + 0.5 * delta_t * v_intp.at(key).y();
+  bool in_domain = true;
+
+#pragma omp parallel for reduction(&& : in_domain) default(none) \
+  shared(delta_t, proj, v_intp, lx, ly)
+  for (std::size_t k = 0; k < proj.size(); ++k) {
+    double x = proj[k].x() + 0.5 * delta_t * v_intp[k].x();
+    double y = proj[k].y() + 0.5 * delta_t * v_intp[k].y();
 
     // if close to 0 using EPS, make 0, or greater than lx or ly, make lx or ly
-    if (abs(x) < dbl_epsilon || abs(x - lx) < dbl_epsilon)
-      x = (abs(x) < dbl_epsilon) ? 0 : lx;
-    if (abs(y) < dbl_epsilon || abs(y - ly) < dbl_epsilon)
-      y = (abs(y) < dbl_epsilon) ? 0 : ly;
+    if (std::abs(x) < dbl_epsilon || std::abs(x - lx) < dbl_epsilon)
+      x = (std::abs(x) < dbl_epsilon) ? 0 : lx;
+    if (std::abs(y) < dbl_epsilon || std::abs(y - ly) < dbl_epsilon)
+      y = (std::abs(y) < dbl_epsilon) ? 0 : ly;
 
     if (x < 0.0 || x > lx || y < 0.0 || y > ly) {
-      return false;
+      in_domain = false;
     }
   }
-  return true;
-}
-
-double calculate_velocity_for_point(
-  unsigned int i,
-  unsigned int j,
-  char direction,
-  double t,
-  const FTReal2d &grid_fluxx_init,
-  const FTReal2d &grid_fluxy_init,
-  const FTReal2d &rho_ft,
-  const FTReal2d &rho_init)
-{
-  double rho = rho_ft(0, 0) + (1.0 - t) * (rho_init(i, j) - rho_ft(0, 0));
-  return (direction == 'x') ? (-grid_fluxx_init(i, j) / rho)
-                            : (-grid_fluxy_init(i, j) / rho);
+  return in_domain;
 }
 
 // Return a map of initial quadtree point to point
@@ -335,73 +466,43 @@ void InsetState::flatten_density_with_node_vertices()
   const double dec_after_not_acc = 0.5;
   const double abs_tol = (std::min(lx_, ly_) * 1e-6);
 
-  // Clear previous triangle transformation data
-  proj_qd_.triangle_transformation.clear();
+  // The quadtree corners are integrated in flat arrays. The k-th element of
+  // proj, eul, mid, v_intp and v_intp_half belongs to vertices[k] of the
+  // Delaunay triangulation. Only the final positions are stored in the
+  // vertex info.
+  std::vector<Delaunay::Vertex_handle> vertices;
+  vertices.reserve(proj_qd_.dt.number_of_vertices());
+  for (const auto vh : proj_qd_.dt.finite_vertex_handles()) {
+    vertices.push_back(vh);
+  }
+  const std::size_t n_corners = vertices.size();
 
-  for (const Point &pt : unique_quadtree_corners_) {
-    proj_qd_.triangle_transformation.insert_or_assign(pt, pt);
+  // proj[k] will be the current position of vertices[k]
+  std::vector<Point> proj;
+  proj.reserve(n_corners);
+  for (const auto vh : vertices) {
+    proj.push_back(vh->point());
   }
 
-  // eul[(i, j)] will be the new position of
-  // proj_qd_.triangle_transformation[(i, j)] proposed by a simple Euler step:
-  // move a full time interval delta_t with the velocity at time t and position
-  // (proj_qd_.triangle_transformation[(i, j)].x,
-  // proj_qd_.triangle_transformation[(i, j)].y)
-  std::unordered_map<Point, Point> eul;
-
-  // mid[(i, j)] will be the new displacement proposed by the midpoint
-  // method (see comment below for the formula)
-  std::unordered_map<Point, Point> mid;
-
-  // v_intp[(i, j)] will be the velocity at position
-  // (proj_qd_.triangle_transformation[(i, j)].x,
-  // proj_qd_.triangle_transformation[(i, j)].y) at time t
-  std::unordered_map<Point, Vector> v_intp;
-
-  // v_intp_half[(i, j)] will be the velocity at the midpoint
-  // (proj_qd_.triangle_transformation[(i, j)].x + 0.5 * delta_t * v_intp[(i,
-  // j)].x, proj_qd_.triangle_transformation[(i, j)].y + 0.5 * delta_t *
-  // v_intp[(i, j)].y) at time t + 0.5 * delta_t
-  std::unordered_map<Point, Vector> v_intp_half;
-
-  // We must typecast lx_ and ly_ as double-precision numbers. Otherwise, the
-  // ratios in the denominator will evaluate as zero.
-  double dlx = lx_;
-  double dly = ly_;
+  // eul[k] will be the new position of proj[k] proposed by a simple Euler
+  // step: move a full time interval delta_t with the velocity at time t and
+  // position (proj[k].x, proj[k].y)
+  std::vector<Point> eul(n_corners);
 
-  // We temporarily insert the Fourier coefficients for the x-components and
-  // y-components of the flux vector into grid_fluxx_init and grid_fluxy_init
-  // The reason for +1 in di+1 stems from the RODFT10 formula at:
-  // https://www.fftw.org/fftw3_doc/1d-Real_002dodd-DFTs-_0028DSTs_0029.html
-#pragma omp parallel for default(none) shared(dlx, dly)
-  for (unsigned int i = 0; i < lx_ - 1; ++i) {
-    const double di = i;
-    for (unsigned int j = 0; j < ly_; ++j) {
-      const double denom =
-        pi * ((di + 1) / dlx + (j / (di + 1)) * (j / dly) * (dlx / dly));
-      grid_fluxx_init_(i, j) = -rho_ft_(i + 1, j) / denom;
-    }
-  }
-  for (unsigned int j = 0; j < ly_; ++j) {
-    grid_fluxx_init_(lx_ - 1, j) = 0.0;
-  }
-#pragma omp parallel for default(none) shared(dlx, dly)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    const double di = i;
-    for (unsigned int j = 0; j < ly_ - 1; ++j) {
-      const double denom =
-        pi * ((di / (j + 1)) * (di / dlx) * (dly / dlx) + (j + 1) / dly);
-      grid_fluxy_init_(i, j) = -rho_ft_(i, j + 1) / denom;
-    }
-  }
-  for (unsigned int i = 0; i < lx_; ++i) {
-    grid_fluxy_init_(i, ly_ - 1) = 0.0;
-  }
+  // mid[k] will be the new displacement proposed by the midpoint method (see
+  // comment below for the formula)
+  std::vector<Point> mid(n_corners);
 
-  // Compute the flux vector and store the result in grid_fluxx_init and
-  // grid_fluxy_init
-  execute_fftw_plans_for_flux();
+  // v_intp[k] will be the velocity at position (proj[k].x, proj[k].y) at
+  // time t
+  std::vector<Vector> v_intp(n_corners);
 
+  // v_intp_half[k] will be the velocity at the midpoint
+  // (proj[k].x + 0.5 * delta_t * v_intp[k].x,
+  // proj[k].y + 0.5 * delta_t * v_intp[k].y) at time t + 0.5 * delta_t
+  std::vector<Vector> v_intp_half(n_corners);
+
+  initialize_flux();
   double t = 0.0;
   double delta_t = 0.30;  // Initial time step.
   unsigned int iter = 0;
@@ -410,56 +511,28 @@ void InsetState::flatten_density_with_node_vertices()
   // Integrate
   while (t < 1.0 && iter <= max_iter) {
 
-    // calculate_velocity lambda function
-    std::function<double(unsigned int, unsigned int, char)>
-      cal_velocity_at_current_time =
-        [&](unsigned int i, unsigned int j, char direction) {
-          return calculate_velocity_for_point(
-            i,
-            j,
-            direction,
-            t,
-            grid_fluxx_init_,
-            grid_fluxy_init_,
-            rho_ft_,
-            rho_init_);
-        };
-
-    for (const auto &[key, val] : proj_qd_.triangle_transformation) {
+#pragma omp parallel for default(none) shared(n_corners, proj, v_intp, t)
+    for (std::size_t k = 0; k < n_corners; ++k) {
 
       // We know, either because of the initialization or because of the
-      // check at the end of the last iteration, that
-      // proj_qd_.triangle_transformation[(i, j)] is inside the rectangle
-      // [0, lx_] x [0, ly_]. This fact guarantees that
-      // interpolate_bilinearly() is given a point that cannot cause it to
-      // fail.
-      Vector v_intp_val(
-        interpolate_bilinearly(
-          val.x(),
-          val.y(),
-          cal_velocity_at_current_time,
-          'x',
-          lx_,
-          ly_),
-        interpolate_bilinearly(
-          val.x(),
-          val.y(),
-          cal_velocity_at_current_time,
-          'y',
-          lx_,
-          ly_));
-      v_intp.insert_or_assign(key, v_intp_val);
+      // check at the end of the last iteration, that proj[k] is inside the
+      // rectangle [0, lx_] x [0, ly_]. This fact guarantees that
+      // velocity() is given a point that cannot cause it to fail.
+      double vx, vy;
+      velocity_field_.velocity(proj[k].x(), proj[k].y(), t, vx, vy);
+      v_intp[k] = Vector(vx, vy);
     }
 
     bool accept = false;
     while (!accept) {
 
       // Simple Euler step.
-      for (const auto &[key, val] : proj_qd_.triangle_transformation) {
-        Point eul_val(
-          val.x() + v_intp[key].x() * delta_t,
-          val.y() + v_intp[key].y() * delta_t);
-        eul.insert_or_assign(key, eul_val);
+#pragma omp parallel for default(none) \
+  shared(n_corners, proj, v_intp, delta_t, eul)
+      for (std::size_t k = 0; k < n_corners; ++k) {
+        eul[k] = Point(
+          proj[k].x() + v_intp[k].x() * delta_t,
+          proj[k].y() + v_intp[k].y() * delta_t);
       }
 
       // Use "explicit midpoint method"
@@ -467,63 +540,42 @@ void InsetState::flatten_density_with_node_vertices()
       //                        y + 0.5 * delta_t *v_y(x, y, t),
       //                        t + 0.5 * delta_t)
       // and similarly for y.
-      std::function<double(unsigned int, unsigned int, char)>
-        cal_velocity_at_mid_time =
-          [&](unsigned int i, unsigned int j, char direction) {
-            return calculate_velocity_for_point(
-              i,
-              j,
-              direction,
-              t + 0.5 * delta_t,
-              grid_fluxx_init_,
-              grid_fluxy_init_,
-              rho_ft_,
-              rho_init_);
-          };
-
       // Make sure we do not pass a point outside [0, lx_] x [0, ly_] to
-      // interpolate_bilinearly(). Otherwise, decrease the time step below and
-      // try again.
-      accept = all_map_points_are_in_domain(
-        delta_t,
-        proj_qd_.triangle_transformation,
-        v_intp,
-        lx_,
-        ly_);
+      // velocity(). Otherwise, decrease the time step below and try again.
+      accept = all_corners_are_in_domain(delta_t, proj, v_intp, lx_, ly_);
       if (accept) {
 
-        // Okay, we can run interpolate_bilinearly()
-        for (const auto &[key, val] : proj_qd_.triangle_transformation) {
-          Vector v_intp_half_val(
-            interpolate_bilinearly(
-              val.x() + 0.5 * delta_t * v_intp[key].x(),
-              val.y() + 0.5 * delta_t * v_intp[key].y(),
-              cal_velocity_at_mid_time,
-              'x',
-              lx_,
-              ly_),
-            interpolate_bilinearly(
-              val.x() + 0.5 * delta_t * v_intp[key].x(),
-              val.y() + 0.5 * delta_t * v_intp[key].y(),
-              cal_velocity_at_mid_time,
-              'y',
-              lx_,
-              ly_));
-          v_intp_half.insert_or_assign(key, v_intp_half_val);
-          Point mid_val(
-            val.x() + v_intp_half[key].x() * delta_t,
-            val.y() + v_intp_half[key].y() * delta_t);
-          mid.insert_or_assign(key, mid_val);
+        // Okay, we can run velocity()
+#pragma omp parallel for default(none) reduction(&& : accept) shared( \
+    abs_tol,                                                          \
+      delta_t,                                                        \
+      eul,                                                            \
+      mid,                                                            \
+      n_corners,                                                      \
+      proj,                                                           \
+      t,                                                              \
+      v_intp,                                                         \
+      v_intp_half)
+        for (std::size_t k = 0; k < n_corners; ++k) {
+          const double x_half = proj[k].x() + 0.5 * delta_t * v_intp[k].x();
+          const double y_half = proj[k].y() + 0.5 * delta_t * v_intp[k].y();
+          double vx_half, vy_half;
+          velocity_field_
+            .velocity(x_half, y_half, t + 0.5 * delta_t, vx_half, vy_half);
+          v_intp_half[k] = Vector(vx_half, vy_half);
+          mid[k] = Point(
+            proj[k].x() + v_intp_half[k].x() * delta_t,
+            proj[k].y() + v_intp_half[k].y() * delta_t);
 
           // Do not accept the integration step if the maximum squared
           // difference between the Euler and midpoint proposals exceeds
           // abs_tol. Neither should we accept the integration step if one
           // of the positions wandered out of the domain. If one of these
           // problems occurred, decrease the time step.
-          const double sq_dist = CGAL::squared_distance(mid[key], eul[key]);
+          const double sq_dist = CGAL::squared_distance(mid[k], eul[k]);
           if (
-            sq_dist > abs_tol || mid[key].x() < 0.0 || mid[key].x() > lx_ ||
-            mid[key].y() < 0.0 || mid[key].y() > ly_) {
+            sq_dist > abs_tol || mid[k].x() < 0.0 || mid[k].x() > lx_ ||
+            mid[k].y() < 0.0 || mid[k].y() > ly_) {
             accept = false;
           }
         }
@@ -542,12 +594,12 @@ void InsetState::flatten_density_with_node_vertices()
     // When we get here, the integration step was accepted
     t += delta_t;
     ++iter;
-
-    // Update the triangle transformation map
-    proj_qd_.triangle_transformation = mid;
+    proj.swap(mid);
     delta_t *= inc_after_acc;  // Try a larger step next time
   }
 
-  // Add current proj to proj_sequence vector
-  proj_sequence_.push_back(proj_qd_);
+  // Store the projected positions in the triangulation
+  for (std::size_t k = 0; k < n_corners; ++k) {
+    vertices[k]->info() = proj[k];
+  }
 }
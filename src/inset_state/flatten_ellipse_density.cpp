@@ -223,11 +223,16 @@ void InsetState::flatten_ellipse_density()
   std::unordered_map<Point, double> rho_mp;
   std::unordered_map<Point, Vector> flux_mp;
 
+  // triangle_transformation[(i, j)] will be the current position of the
+  // quadtree corner (i, j). The final positions are stored in the vertex
+  // info of proj_qd_.dt.
+  std::unordered_map<Point, Point> triangle_transformation;
+
   // eul[(i, j)] will be the new position of
-  // proj_qd_.triangle_transformation[(i, j)] proposed by a simple Euler step:
+  // triangle_transformation[(i, j)] proposed by a simple Euler step:
   // move a full time interval delta_t with the velocity at time t and position
-  // (proj_qd_.triangle_transformation[(i, j)].x,
-  // proj_qd_.triangle_transformation[(i, j)].y)
+  // (triangle_transformation[(i, j)].x,
+  // triangle_transformation[(i, j)].y)
   std::unordered_map<Point, Point> eul;
 
   // mid[(i, j)] will be the new displacement proposed by the midpoint
@@ -235,13 +240,13 @@ void InsetState::flatten_ellipse_density()
   std::unordered_map<Point, Point> mid;
 
   // v_intp[(i, j)] will be the velocity at position
-  // (proj_qd_.triangle_transformation[(i, j)].x,
-  // proj_qd_.triangle_transformation[(i, j)].y) at time t
+  // (triangle_transformation[(i, j)].x,
+  // triangle_transformation[(i, j)].y) at time t
   std::unordered_map<Point, Vector> v_intp;
 
   // v_intp_half[(i, j)] will be the velocity at the midpoint
-  // (proj_qd_.triangle_transformation[(i, j)].x + 0.5 * delta_t * v_intp[(i,
-  // j)].x, proj_qd_.triangle_transformation[(i, j)].y + 0.5 * delta_t *
+  // (triangle_transformation[(i, j)].x + 0.5 * delta_t * v_intp[(i,
+  // j)].x, triangle_transformation[(i, j)].y + 0.5 * delta_t *
   // v_intp[(i, j)].y) at time t + 0.5 * delta_t
   std::unordered_map<Point, Vector> v_intp_half;
 
@@ -252,11 +257,9 @@ void InsetState::flatten_ellipse_density()
   const double dec_after_not_acc = 0.75;
   const double abs_tol = (std::min(lx_, ly_) * 1e-6);
 
-  // Clear previous triangle transformation data
-  proj_qd_.triangle_transformation.clear();
-
+  // Start from the identity
   for (const Point &pt : unique_quadtree_corners_) {
-    proj_qd_.triangle_transformation.insert_or_assign(pt, pt);
+    triangle_transformation.insert_or_assign(pt, pt);
   }
 
   // We assume that target areas that were zero or missing in the input have
@@ -357,7 +360,7 @@ void InsetState::flatten_ellipse_density()
   }
 
   // Calculate densities
-  for (const auto &[start_pt, curr_pt] : proj_qd_.triangle_transformation) {
+  for (const auto &[start_pt, curr_pt] : triangle_transformation) {
     double rho = rho_mean;
     double flux_x = 0.0;
     double flux_y = 0.0;
@@ -416,11 +419,11 @@ void InsetState::flatten_ellipse_density()
     calculate_velocity(
       rho_mp,
       flux_mp,
-      proj_qd_.triangle_transformation,
+      triangle_transformation,
       velocity);
 
     // calculating velocity at t by filling v_intp
-    for (const auto &[key, val] : proj_qd_.triangle_transformation) {
+    for (const auto &[key, val] : triangle_transformation) {
       Vector v_intp_val(interpolate(val, proj_qd_.dt, velocity));
       v_intp.insert_or_assign(key, v_intp_val);
     }
@@ -429,12 +432,12 @@ void InsetState::flatten_ellipse_density()
       calculate_velocity(
         rho_mp,
         flux_mp,
-        proj_qd_.triangle_transformation,
+        triangle_transformation,
         velocity);
 
       accept = all_map_points_are_in_domain(
         delta_t,
-        proj_qd_.triangle_transformation,
+        triangle_transformation,
         v_intp,
         lx_,
         ly_);
@@ -442,14 +445,14 @@ void InsetState::flatten_ellipse_density()
       if (accept) {
 
         // Simple Euler step.
-        for (const auto &[key, val] : proj_qd_.triangle_transformation) {
+        for (const auto &[key, val] : triangle_transformation) {
           Point eul_val(
             val.x() + v_intp[key].x() * delta_t,
             val.y() + v_intp[key].y() * delta_t);
           eul.insert_or_assign(key, eul_val);
         }
 
-        for (const auto &[key, val] : proj_qd_.triangle_transformation) {
+        for (const auto &[key, val] : triangle_transformation) {
           Point n_val = Point(
             val.x() + 0.5 * delta_t * v_intp[key].x(),
             val.y() + 0.5 * delta_t * v_intp[key].y());
@@ -502,7 +505,12 @@ void InsetState::flatten_ellipse_density()
     ++iter;
 
     // Update the triangle transformation map
-    proj_qd_.triangle_transformation = mid;
+    triangle_transformation = mid;
     delta_t *= inc_after_acc;  // Try a larger step next time
   }
+
+  // Store the projected positions in the triangulation
+  for (const auto vh : proj_qd_.dt.finite_vertex_handles()) {
+    vh->info() = triangle_transformation.at(vh->point());
+  }
 }
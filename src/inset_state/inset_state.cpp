@@ -1,5 +1,6 @@
 #include "inset_state.hpp"
 #include "constants.hpp"
+#include "fftw_planner.hpp"
 
 InsetState::InsetState(std::string pos) : pos_(std::move(pos))
 {
@@ -70,84 +71,120 @@ void InsetState::create_delaunay_t()
   points.insert(Point(0, ly_));
   points.insert(Point(lx_, 0));
   points.insert(Point(lx_, ly_));
-  std::vector<Point> points_vec;
-
-  // Copy points of unordered_set to vector
-  std::copy(points.begin(), points.end(), std::back_inserter(points_vec));
-
-  // Create the quadtree and 'grade' it so that neighboring quadtree leaves
-  // differ by a depth that can only be 0 or 1.
-  Quadtree qt(points_vec, Quadtree::PointMap(), 1);
-  const unsigned int depth =
-    static_cast<unsigned int>(std::max(log2(lx_), log2(ly_)));
-  std::cerr << "Using Quadtree depth: " << depth << std::endl;
-  qt.refine(
-    depth,
-    9);  // (maximum depth, splitting condition: max number of points per node)
-  qt.grade();
-  std::cerr << "Quadtree root node bounding box: " << qt.bbox(qt.root())
-            << std::endl;
-
-  // Clear corner points from last iteration
-  unique_quadtree_corners_.clear();
-
-  // Clear the vector of bounding boxes
-  quadtree_bboxes_.clear();
 
-  // Get unique quadtree corners
-  for (const auto &node : qt.traverse<CGAL::Orthtrees::Leaves_traversal>()) {
-
-    // Get bounding box of the leaf node
-    const Bbox bbox = qt.bbox(node);
+  // Update the quadtree with the current positions of the points. Only the
+  // leaves whose number of points crossed the splitting threshold since the
+  // last integration are split or merged.
+  std::vector<std::uint64_t> codes;
+  codes.reserve(points.size());
+  for (const auto &pt : points) {
+    codes.push_back(quadtree_.point_code(pt.x(), pt.y()));
+  }
+  const std::size_t n_changed_leaves = quadtree_.update(std::move(codes));
+  std::cerr << "Using Quadtree depth: " << quadtree_.max_depth()
+            << ", number of split and merged leaves: " << n_changed_leaves
+            << std::endl;
 
-    // Store the bounding box
-    quadtree_bboxes_.push_back(bbox);
+  // If no leaf changed, neither did the corners, and we can keep the
+  // triangulation of the last integration
+  Delaunay &dt = proj_qd_.dt;
+  if (n_changed_leaves > 0 || dt.number_of_vertices() == 0) {
+
+    // Get unique corners of the leaves of the 'graded' quadtree, in which
+    // neighbouring leaves differ by a depth that can only be 0 or 1
+    std::unordered_set<Point> corners;
+    corners.reserve(2 * unique_quadtree_corners_.size());
+    quadtree_bboxes_.clear();
+    for (const auto leaf : quadtree_.graded_leaves()) {
+      const auto [xmin, ymin, xmax, ymax] = quadtree_.bbox(leaf);
+
+      // Store the bounding box
+      quadtree_bboxes_.emplace_back(xmin, ymin, xmax, ymax);
+
+      // check if points are between lx_ and ly_
+      if (xmin < 0 || xmax > lx_ || ymin < 0 || ymax > ly_) {
+        continue;
+      }
 
-    // check if points are between lx_ and ly_
-    if (
-      bbox.xmin() < 0 || bbox.xmax() > lx_ || bbox.ymin() < 0 ||
-      bbox.ymax() > ly_) {
-      continue;
+      // Insert the four vertices of the bbox into the corners set
+      corners.insert(Point(xmin, ymin));
+      corners.insert(Point(xmax, ymax));
+      corners.insert(Point(xmin, ymax));
+      corners.insert(Point(xmax, ymin));
     }
 
-    // Insert the four vertices of the bbox into the corners set
-    unique_quadtree_corners_.insert(Point(bbox.xmin(), bbox.ymin()));
-    unique_quadtree_corners_.insert(Point(bbox.xmax(), bbox.ymax()));
-    unique_quadtree_corners_.insert(Point(bbox.xmin(), bbox.ymax()));
-    unique_quadtree_corners_.insert(Point(bbox.xmax(), bbox.ymin()));
+    // Add boundary points of mapping domain in case they are omitted due to
+    // quadtree structure
+    corners.insert(Point(0, 0));
+    corners.insert(Point(0, ly_));
+    corners.insert(Point(lx_, 0));
+    corners.insert(Point(lx_, ly_));
+
+    // Update the Delaunay triangulation in place by inserting the new
+    // corners and removing the corners that are gone. If most corners
+    // changed, triangulating from scratch is faster.
+    std::vector<Point> inserted;
+    for (const auto &pt : corners) {
+      if (!unique_quadtree_corners_.contains(pt)) {
+        inserted.push_back(pt);
+      }
+    }
+    std::vector<Delaunay::Vertex_handle> removed;
+    for (const auto vh : dt.finite_vertex_handles()) {
+      if (!corners.contains(vh->point())) {
+        removed.push_back(vh);
+      }
+    }
+    if (2 * (inserted.size() + removed.size()) > corners.size()) {
+      dt.clear();
+      dt.insert(corners.begin(), corners.end());
+    } else {
+      dt.insert(inserted.begin(), inserted.end());
+      for (const auto vh : removed) {
+        dt.remove(vh);
+      }
+    }
+    std::cerr << "Inserted " << inserted.size() << " and removed "
+              << removed.size() << " corners" << std::endl;
+    unique_quadtree_corners_ = std::move(corners);
   }
-
-  // Add boundary points of mapping domain in case they are omitted due to
-  // quadtree structure
-  unique_quadtree_corners_.insert(Point(0, 0));
-  unique_quadtree_corners_.insert(Point(0, ly_));
-  unique_quadtree_corners_.insert(Point(lx_, 0));
-  unique_quadtree_corners_.insert(Point(lx_, ly_));
-
   std::cerr << "Number of unique corners: " << unique_quadtree_corners_.size()
             << std::endl;
 
-  // Create the Delaunay triangulation
-  Delaunay dt;
-  dt.insert(unique_quadtree_corners_.begin(), unique_quadtree_corners_.end());
-  proj_qd_.dt = dt;
+  // Until the corners are integrated, each vertex is projected onto itself
+  for (const auto vh : dt.finite_vertex_handles()) {
+    vh->info() = vh->point();
+  }
   std::cerr << "Number of Delaunay triangles: " << dt.number_of_faces()
             << std::endl;
 }
 
-double InsetState::area_error_at(const std::string &id) const
+double InsetState::area_error_at(const unsigned int gd_index) const
 {
-  return area_errors_.at(id);
+  return area_errors_[gd_index];
 }
 
 Bbox InsetState::bbox(bool original_bbox) const
 {
-  auto &geo_divs = original_bbox ? geo_divs_original_ : geo_divs_;
-  // Find joint bounding box for all "polygons with holes" in this inset
   double inset_xmin = dbl_inf;
   double inset_xmax = -dbl_inf;
   double inset_ymin = dbl_inf;
   double inset_ymax = -dbl_inf;
+
+  // The bounding boxes of the current GeoDivs are cached
+  if (!original_bbox) {
+    update_geometry_cache();
+    for (const auto &bb : geo_div_bboxes_) {
+      inset_xmin = std::min(bb.xmin(), inset_xmin);
+      inset_ymin = std::min(bb.ymin(), inset_ymin);
+      inset_xmax = std::max(bb.xmax(), inset_xmax);
+      inset_ymax = std::max(bb.ymax(), inset_ymax);
+    }
+    return {inset_xmin, inset_ymin, inset_xmax, inset_ymax};
+  }
+
+  // Find joint bounding box for all "polygons with holes" in this inset
+  const auto &geo_divs = geo_divs_original_;
 #pragma omp parallel for default(none) shared(geo_divs) \
   reduction(min : inset_xmin, inset_ymin)               \
   reduction(max : inset_xmax, inset_ymax)
@@ -173,6 +210,11 @@ bool InsetState::color_found(const std::string &id) const
   return colors_.count(id);
 }
 
+const convergence_report &InsetState::convergence() const
+{
+  return convergence_;
+}
+
 bool InsetState::colors_empty() const
 {
   return colors_.empty();
@@ -183,32 +225,38 @@ unsigned int InsetState::colors_size() const
   return colors_.size();
 }
 
-void InsetState::destroy_fftw_plans_for_flux()
+void InsetState::execute_fftw_bwd_plan() const
 {
-  grid_fluxx_init_.destroy_fftw_plan();
-  grid_fluxy_init_.destroy_fftw_plan();
+  fftw_execute_r2r(
+    bwd_plan_for_rho_,
+    rho_ft_.as_1d_array(),
+    rho_init_.as_1d_array());
 }
 
-void InsetState::destroy_fftw_plans_for_rho()
+void InsetState::execute_fftw_plans_for_flux()
 {
-  fftw_destroy_plan(fwd_plan_for_rho_);
-  fftw_destroy_plan(bwd_plan_for_rho_);
+  grid_fluxx_init_.execute_fftw_plan();
+  grid_fluxy_init_.execute_fftw_plan();
 }
 
-void InsetState::execute_fftw_bwd_plan() const
+void InsetState::execute_fftw_fwd_plan() const
 {
-  fftw_execute(bwd_plan_for_rho_);
+  fftw_execute_r2r(
+    fwd_plan_for_rho_,
+    rho_init_.as_1d_array(),
+    rho_ft_.as_1d_array());
 }
 
-void InsetState::execute_fftw_plans_for_flux()
+double InsetState::geo_div_area(const unsigned int gd) const
 {
-  grid_fluxx_init_.execute_fftw_plan();
-  grid_fluxy_init_.execute_fftw_plan();
+  update_geometry_cache();
+  return geo_div_areas_[gd];
 }
 
-void InsetState::execute_fftw_fwd_plan() const
+Bbox InsetState::geo_div_bbox(const unsigned int gd) const
 {
-  fftw_execute(fwd_plan_for_rho_);
+  update_geometry_cache();
+  return geo_div_bboxes_[gd];
 }
 
 const std::vector<GeoDiv> &InsetState::geo_divs() const
@@ -223,24 +271,14 @@ void InsetState::increment_integration()
 
 void InsetState::initialize_cum_proj()
 {
-  cum_proj_.resize(boost::extents[lx_][ly_]);
-
-#pragma omp parallel for default(none)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      cum_proj_[i][j] = Point(i + 0.5, j + 0.5);
-    }
-  }
+  cum_proj_.resize(lx_, ly_);
+  cum_proj_.fill_with_lattice_points();
 }
 
 void InsetState::initialize_identity_proj()
 {
-  identity_proj_.resize(boost::extents[lx_][ly_]);
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      identity_proj_[i][j] = Point(i + 0.5, j + 0.5);
-    }
-  }
+  identity_proj_.resize(lx_, ly_);
+  identity_proj_.fill_with_lattice_points();
 }
 
 void InsetState::insert_color(const std::string &id, const Color &c)
@@ -318,22 +356,22 @@ unsigned int InsetState::ly() const
 
 void InsetState::make_fftw_plans_for_rho()
 {
-  fwd_plan_for_rho_ = fftw_plan_r2r_2d(
-    static_cast<int>(lx_),  // fftw_plan_...() uses signed integers.
-    static_cast<int>(ly_),
+  // Unless the planner flag is FFTW_ESTIMATE, planning overwrites rho_init_
+  // and rho_ft_. Hence, the plans must be made before filling the arrays.
+  fwd_plan_for_rho_ = cached_fftw_plan(
+    lx_,
+    ly_,
     rho_init_.as_1d_array(),
     rho_ft_.as_1d_array(),
     FFTW_REDFT10,
-    FFTW_REDFT10,
-    FFTW_ESTIMATE);
-  bwd_plan_for_rho_ = fftw_plan_r2r_2d(
-    static_cast<int>(lx_),
-    static_cast<int>(ly_),
+    FFTW_REDFT10);
+  bwd_plan_for_rho_ = cached_fftw_plan(
+    lx_,
+    ly_,
     rho_ft_.as_1d_array(),
     rho_init_.as_1d_array(),
     FFTW_REDFT01,
-    FFTW_REDFT01,
-    FFTW_ESTIMATE);
+    FFTW_REDFT01);
 }
 
 void InsetState::make_fftw_plans_for_flux()
@@ -342,20 +380,6 @@ void InsetState::make_fftw_plans_for_flux()
   grid_fluxy_init_.make_fftw_plan(FFTW_REDFT01, FFTW_RODFT01);
 }
 
-struct max_area_error_info InsetState::max_area_error() const
-{
-  auto it = area_errors_.begin();
-  std::string worst_gd = it->first;
-  double value = it->second;
-  for (const auto &[gd_id, area_error] : area_errors_) {
-    if (area_error > value) {
-      value = area_error;
-      worst_gd = gd_id;
-    }
-  }
-  return {value, worst_gd};
-}
-
 unsigned int InsetState::n_finished_integrations() const
 {
   return n_finished_integrations_;
@@ -402,14 +426,10 @@ std::string InsetState::pos() const
   return pos_;
 }
 
-double InsetState::area_drift() const
-{
-  return (total_inset_area() / initial_area_);
-}
-
 void InsetState::push_back(const GeoDiv &gd)
 {
   geo_divs_.push_back(gd);
+  invalidate_geometry_caches();
 }
 
 FTReal2d &InsetState::ref_to_fluxx_init()
@@ -454,6 +474,7 @@ void InsetState::remove_tiny_polygons(const double &minimum_polygon_size)
     geo_divs_cleaned.push_back(gd_cleaned);
   }
   geo_divs_ = std::move(geo_divs_cleaned);
+  invalidate_geometry_caches();
 }
 
 void InsetState::replace_target_area(const std::string &id, const double area)
@@ -470,28 +491,56 @@ void InsetState::set_area_errors()
 {
   // Formula for relative area error:
   // area_on_cartogram / target_area - 1
+  // The GeoDiv areas are cached, and they are summed in a fixed order. A
+  // parallel reduction of floating-point numbers would make the result
+  // depend on the number of threads.
+  update_geometry_cache();
+  const std::vector<double> &cart_areas = geo_div_areas_;
   double sum_target_area = 0.0;
   double sum_cart_area = 0.0;
-
-#pragma omp parallel for default(none) \
-  reduction(+ : sum_target_area, sum_cart_area)
-  for (const auto &gd : geo_divs_) {
-    sum_target_area += target_area_at(gd.id());
-    sum_cart_area += gd.area();
+  for (std::size_t i = 0; i < geo_divs_.size(); ++i) {
+    sum_target_area += target_area_at(geo_divs_[i].id());
+    sum_cart_area += cart_areas[i];
   }
 
-#pragma omp parallel for default(none) shared(sum_cart_area, sum_target_area)
-  for (const auto &gd : geo_divs_) {
+  // Area errors and convergence metrics in a single pass over the GeoDivs.
+  // The upper edges of the histogram bins are at 0.001, 0.01, 0.1 and 1.
+  constexpr std::array<double, 4> bin_edges = {1e-3, 1e-2, 1e-1, 1.0};
+  convergence_ = convergence_report{};
+  convergence_.area_drift = total_inset_area_ / initial_area_;
+  area_errors_.resize(geo_divs_.size());
+  std::size_t worst_gd = 0;
+  double sum_area_error = 0.0;
+  double sum_sq_area_error = 0.0;
+  for (std::size_t i = 0; i < geo_divs_.size(); ++i) {
+    const auto &id = geo_divs_[i].id();
     const double obj_area =
-      target_area_at(gd.id()) * sum_cart_area / sum_target_area;
-    area_errors_[gd.id()] = std::abs((gd.area() / obj_area) - 1);
+      target_area_at(id) * sum_cart_area / sum_target_area;
+    const double area_error = std::abs((cart_areas[i] / obj_area) - 1);
+    area_errors_[i] = area_error;
+    if (area_error > area_errors_[worst_gd]) {
+      worst_gd = i;
+    }
+    sum_area_error += area_error;
+    sum_sq_area_error += area_error * area_error;
+    ++convergence_.area_error_histogram[static_cast<std::size_t>(
+      std::upper_bound(bin_edges.begin(), bin_edges.end(), area_error) -
+      bin_edges.begin())];
+  }
+  if (!geo_divs_.empty()) {
+    const auto n = static_cast<double>(geo_divs_.size());
+    convergence_.max_area_error = {
+      area_errors_[worst_gd],
+      geo_divs_[worst_gd].id()};
+    convergence_.mean_area_error = sum_area_error / n;
+    convergence_.rms_area_error = std::sqrt(sum_sq_area_error / n);
   }
 }
 
 void InsetState::adjust_grid()
 {
   unsigned int long_grid_length = std::max(lx_, ly_);
-  double curr_max_area_error = max_area_error().value;
+  double curr_max_area_error = convergence_.max_area_error.value;
   unsigned int grid_factor =
     (long_grid_length > default_long_grid_length) ? 2 : default_grid_factor;
   max_area_errors_.push_back(curr_max_area_error);
@@ -510,13 +559,7 @@ void InsetState::adjust_grid()
                 << std::endl;
       return;
     }
-    lx_ *= grid_factor;
-    ly_ *= grid_factor;
-
-    // Reallocate FFTW plans
-    ref_to_rho_init().allocate(lx_, ly_);
-    ref_to_rho_ft().allocate(lx_, ly_);
-    make_fftw_plans_for_rho();
+    refine_grid(grid_factor);
     std::cerr << "New grid dimensions: " << lx_ << " " << ly_ << std::endl;
   }
 }
@@ -527,6 +570,7 @@ void InsetState::set_grid_dimensions(
 {
   lx_ = lx;
   ly_ = ly;
+  invalidate_geometry_caches();
 }
 
 void InsetState::set_inset_name(const std::string &inset_name)
@@ -557,11 +601,30 @@ double InsetState::target_area_at(const std::string &id) const
 
 double InsetState::total_inset_area() const
 {
-  double total_inset_area = 0.0;
-  for (const auto &gd : geo_divs_) {
-    total_inset_area += gd.area();
+  update_geometry_cache();
+  return total_inset_area_;
+}
+
+void InsetState::update_geometry_cache() const
+{
+  if (geometry_cache_generation_ == geometry_generation_) {
+    return;
   }
-  return total_inset_area;
+  geo_div_areas_.resize(geo_divs_.size());
+  geo_div_bboxes_.resize(geo_divs_.size());
+#pragma omp parallel for default(none)
+  for (std::size_t i = 0; i < geo_divs_.size(); ++i) {
+    geo_div_areas_[i] = geo_divs_[i].area();
+    geo_div_bboxes_[i] = geo_divs_[i].bbox();
+  }
+
+  // Sum in a fixed order, so that the total area does not depend on the
+  // number of threads
+  total_inset_area_ = 0.0;
+  for (const double area : geo_div_areas_) {
+    total_inset_area_ += area;
+  }
+  geometry_cache_generation_ = geometry_generation_;
 }
 
 double InsetState::total_target_area() const
@@ -586,45 +649,11 @@ void InsetState::store_original_geo_divs()
   geo_divs_original_ = geo_divs_;
 }
 
-void InsetState::transform_points(
-  const std::function<Point(Point)> &transform_point,
-  bool project_original)
-{
-
-  auto &geo_divs = project_original ? geo_divs_original_ : geo_divs_;
-
-  // Iterate over GeoDivs
-#pragma omp parallel for default(none) shared(transform_point, geo_divs)
-  for (auto &gd : geo_divs) {
-
-    // Iterate over Polygon_with_holes
-    for (auto &pwh : gd.ref_to_polygons_with_holes()) {
-
-      // Get outer boundary
-      auto &outer_boundary = pwh.outer_boundary();
-
-      // Iterate over outer boundary's coordinates
-      for (auto &coords_outer : outer_boundary) {
-
-        // Assign outer boundary's coordinates to transformed coordinates
-        coords_outer = transform_point(coords_outer);
-      }
-
-      // Iterate over holes
-      for (auto &h : pwh.holes()) {
-
-        // Iterate over hole's coordinates
-        for (auto &coords_hole : h) {
-
-          // Assign hole's coordinates to transformed coordinates
-          coords_hole = transform_point(coords_hole);
-        }
-      }
-    }
-  }
-}
-
 void InsetState::set_geo_divs(std::vector<GeoDiv> new_geo_divs)
 {
   geo_divs_ = std::move(new_geo_divs);
+  invalidate_geometry_caches();
+
+  // The rasterized GeoDivs no longer match
+  exact_coverage_.reset(lx_, ly_);
 }
@@ -1,83 +1,106 @@
 #include "inset_state.hpp"
-#include "interpolate_bilinearly.hpp"
 #include "matrix.hpp"
+#include "padded_grid.hpp"
 #include "round_point.hpp"
 
-Point interpolate_point_bilinearly(
-  const Point p1,
-  const boost::multi_array<double, 2> &xdisp,
-  const boost::multi_array<double, 2> &ydisp,
+// The displacement is only defined inside the lattice
+static void exit_if_outside_lattice(
+  const double *x,
+  const double *y,
+  const std::size_t n,
   const unsigned int lx,
   const unsigned int ly)
 {
-  const double intp_x =
-    interpolate_bilinearly(p1.x(), p1.y(), xdisp, 'x', lx, ly);
-  const double intp_y =
-    interpolate_bilinearly(p1.x(), p1.y(), ydisp, 'y', lx, ly);
-  return {p1.x() + intp_x, p1.y() + intp_y};
+  for (std::size_t k = 0; k < n; ++k) {
+    if (x[k] < 0 || x[k] > lx || y[k] < 0 || y[k] > ly) {
+      std::cerr << "ERROR: coordinate outside bounding box in project().\n"
+                << "x=" << x[k] << ", y=" << y[k] << std::endl;
+      exit(1);
+    }
+  }
 }
 
 void InsetState::project()
 {
-  // Calculate displacement from proj array
-  boost::multi_array<double, 2> xdisp(boost::extents[lx_][ly_]);
-  boost::multi_array<double, 2> ydisp(boost::extents[lx_][ly_]);
+  // Calculate displacement from proj array. As for the velocity, the
+  // x-displacement vanishes on the edges x = 0 and x = lx_, the
+  // y-displacement on the edges y = 0 and y = ly_.
+  PaddedGrid xdisp, ydisp;
+  xdisp.allocate(lx_, ly_, 'x');
+  ydisp.allocate(lx_, ly_, 'y');
 
 #pragma omp parallel for default(none) shared(xdisp, ydisp)
   for (unsigned int i = 0; i < lx_; ++i) {
     for (unsigned int j = 0; j < ly_; ++j) {
-      xdisp[i][j] = proj_[i][j].x() - i - 0.5;
-      ydisp[i][j] = proj_[i][j].y() - j - 0.5;
+      xdisp(i, j) = proj_.x(i, j) - i - 0.5;
+      ydisp(i, j) = proj_.y(i, j) - j - 0.5;
     }
   }
+  xdisp.fill_ghost_cells();
+  ydisp.fill_ghost_cells();
 
-// Cumulative projection
-#pragma omp parallel for default(none) shared(xdisp, ydisp)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
+  // Cumulative projection, one row at a time
+#pragma omp parallel default(none) shared(xdisp, ydisp)
+  {
+    std::vector<double> grid_intp_x(ly_), grid_intp_y(ly_);
+
+#pragma omp for
+    for (unsigned int i = 0; i < lx_; ++i) {
 
-      // TODO: Should the interpolation be made on the basis of triangulation?
+      // TODO: Should the interpolation be made on the basis of
+      // triangulation?
       // Calculate displacement for cumulative grid coordinates
-      const double grid_intp_x = interpolate_bilinearly(
-        cum_proj_[i][j].x(),
-        cum_proj_[i][j].y(),
-        xdisp,
-        'x',
-        lx_,
-        ly_);
-      const double grid_intp_y = interpolate_bilinearly(
-        cum_proj_[i][j].x(),
-        cum_proj_[i][j].y(),
-        ydisp,
-        'y',
-        lx_,
-        ly_);
+      double *x = cum_proj_.x_row(i);
+      double *y = cum_proj_.y_row(i);
+      exit_if_outside_lattice(x, y, ly_, lx_, ly_);
+      xdisp.interpolate_bilinearly(x, y, ly_, grid_intp_x.data());
+      ydisp.interpolate_bilinearly(x, y, ly_, grid_intp_y.data());
 
       // Update cumulative grid coordinates
-      cum_proj_[i][j] = Point(
-        cum_proj_[i][j].x() + grid_intp_x,
-        cum_proj_[i][j].y() + grid_intp_y);
+      for (unsigned int j = 0; j < ly_; ++j) {
+        x[j] += grid_intp_x[j];
+        y[j] += grid_intp_y[j];
+      }
     }
   }
 
-  // Specialize (i.e., curry) interpolate_point_bilinearly() such that it only
-  // requires one argument (Point p1).
-  std::function<Point(Point)> lambda =
-    [&xdisp, &ydisp, lx = lx_, ly = ly_](Point p1) {
-      return interpolate_point_bilinearly(p1, xdisp, ydisp, lx, ly);
-    };
-
-  // Apply "lambda" to all points
-  transform_points(lambda);
+  // Displace the points of each ring. The coordinates are copied into
+  // separate x- and y-arrays, which the vectorized kernels of PaddedGrid
+  // interpolate in one pass.
+  transform_rings([&xdisp, &ydisp, lx = lx_, ly = ly_](
+                    const std::span<Point> ring) {
+    thread_local std::vector<double> x, y, intp_x, intp_y;
+    const std::size_t n = ring.size();
+    x.resize(n);
+    y.resize(n);
+    intp_x.resize(n);
+    intp_y.resize(n);
+    for (std::size_t k = 0; k < n; ++k) {
+      x[k] = ring[k].x();
+      y[k] = ring[k].y();
+    }
+    exit_if_outside_lattice(x.data(), y.data(), n, lx, ly);
+    xdisp.interpolate_bilinearly(x.data(), y.data(), n, intp_x.data());
+    ydisp.interpolate_bilinearly(x.data(), y.data(), n, intp_y.data());
+    for (std::size_t k = 0; k < n; ++k) {
+      ring[k] = Point(x[k] + intp_x[k], y[k] + intp_y[k]);
+    }
+  });
 }
 
+// Project p with the barycentric coordinates of the Delaunay triangle that
+// contains it. The search starts at the face `hint`, which is updated to the
+// triangle that is found. Consecutive vertices of a ring are usually in the
+// same or a neighbouring triangle, so that locating them is cheap if the
+// previous triangle is passed as hint.
 Point interpolate_point_with_barycentric_coordinates(
   const Point &p,
   const Delaunay &dt,
-  const std::unordered_map<Point, Point> &proj_map)
+  Face_handle &hint)
 {
   // Find the triangle containing the point
-  const Face_handle fh = dt.locate(p);
+  const Face_handle fh = dt.locate(p, hint);
+  hint = fh;
 
   // Get the three vertices
   const Point v1 = fh->vertex(0)->point();
@@ -98,9 +121,9 @@ Point interpolate_point_with_barycentric_coordinates(
   const double bary_z = std::get<2>(bary_coor);
 
   // Get projected vertices
-  const Point v1_proj = proj_map.at(v1);
-  const Point v2_proj = proj_map.at(v2);
-  const Point v3_proj = proj_map.at(v3);
+  const Point &v1_proj = fh->vertex(0)->info();
+  const Point &v2_proj = fh->vertex(1)->info();
+  const Point &v3_proj = fh->vertex(2)->info();
 
   // Calculate projected point of p
   return {
@@ -108,14 +131,47 @@ Point interpolate_point_with_barycentric_coordinates(
     bary_x * v1_proj.y() + bary_y * v2_proj.y() + bary_z * v3_proj.y()};
 }
 
+// The vertices of each ring are projected in order so that each locate()
+// starts at the triangle of the previous vertex. The hint is local to the
+// ring; hence, the threads that process different rings do not share it.
 void InsetState::project_with_delaunay_t()
 {
-  std::function<Point(Point)> lambda_bary =
-    [&dt = proj_qd_.dt,
-     &proj_map = proj_qd_.triangle_transformation](Point p1) {
-      return interpolate_point_with_barycentric_coordinates(p1, dt, proj_map);
-    };
-  transform_points(lambda_bary);
+  const auto lambda_bary = [&dt = proj_qd_.dt](const std::span<Point> ring) {
+    Face_handle hint;
+    for (auto &p : ring) {
+      p = interpolate_point_with_barycentric_coordinates(p, dt, hint);
+    }
+  };
+  transform_rings(lambda_bary);
+
+  // Cumulative projection. In the first integration, it is the projection
+  // itself. Afterwards, we move the current positions of its vertices with
+  // the projection, like cum_proj_ in project_with_triangulation(). Thus,
+  // we only keep two triangulations, however many integrations there are.
+  if (cum_proj_qd_.dt.number_of_vertices() == 0) {
+    cum_proj_qd_ = proj_qd_;
+    return;
+  }
+  std::vector<Delaunay::Vertex_handle> vertices;
+  vertices.reserve(cum_proj_qd_.dt.number_of_vertices());
+  for (const auto vh : cum_proj_qd_.dt.finite_vertex_handles()) {
+    vertices.push_back(vh);
+  }
+
+#pragma omp parallel default(none) shared(vertices)
+  {
+    // One locate hint per thread. The vertices are in the spatially sorted
+    // order in which they were inserted into the triangulation.
+    Face_handle hint;
+
+#pragma omp for
+    for (std::size_t k = 0; k < vertices.size(); ++k) {
+      vertices[k]->info() = interpolate_point_with_barycentric_coordinates(
+        vertices[k]->info(),
+        proj_qd_.dt,
+        hint);
+    }
+  }
 }
 
 // In chosen_diag() and transformed_triangle(), the input x-coordinates can
@@ -145,8 +201,8 @@ Point InsetState::projected_point(const Point &p1, const bool project_original)
     static_cast<unsigned int>(ly_) - 1,
     static_cast<unsigned int>(p1.y()));
   return {
-    (p1.x() == 0.0 || p1.x() == lx_) ? p1.x() : proj[proj_x][proj_y].x(),
-    (p1.y() == 0.0 || p1.y() == ly_) ? p1.y() : proj[proj_x][proj_y].y()};
+    (p1.x() == 0.0 || p1.x() == lx_) ? p1.x() : proj.x(proj_x, proj_y),
+    (p1.y() == 0.0 || p1.y() == ly_) ? p1.y() : proj.y(proj_x, proj_y)};
 }
 
 // TODO: chosen_diag() seems to be more naturally thought of as a boolean
@@ -179,28 +235,24 @@ int InsetState::chosen_diag(
     tv[i] = projected_point(v[i], project_original);
   }
 
-  // Get the two possible midpoints
-  const Point midpoint_diag_0(
-    (tv[0].x() + tv[2].x()) / 2,
-    (tv[0].y() + tv[2].y()) / 2);
-  const Point midpoint_diag_1(
-    (tv[1].x() + tv[3].x()) / 2,
-    (tv[1].y() + tv[3].y()) / 2);
-
-  // Get the transformed grid cell as a polygon
-  Polygon trans_grid;
-  for (auto &i : tv) {
-    trans_grid.push_back(i);
-  }
-
-  // Check if grid cell is concave
-  if (!trans_grid.is_convex()) {
+  // A diagonal is inside a simple quadrilateral if and only if the other
+  // two corners lie strictly on opposite sides of it. The cell is convex if
+  // and only if both diagonals are inside.
+  const auto cross = [](const Point &a, const Point &b, const Point &c) {
+    return (b.x() - a.x()) * (c.y() - a.y()) -
+           (b.y() - a.y()) * (c.x() - a.x());
+  };
+  const bool diag_0_is_inside =
+    cross(tv[0], tv[2], tv[1]) * cross(tv[0], tv[2], tv[3]) < 0.0;
+  const bool diag_1_is_inside =
+    cross(tv[1], tv[3], tv[0]) * cross(tv[1], tv[3], tv[2]) < 0.0;
+  if (!(diag_0_is_inside && diag_1_is_inside)) {
     num_concave += 1;
   }
-  if (trans_grid.bounded_side(midpoint_diag_0) == CGAL::ON_BOUNDED_SIDE) {
+  if (diag_0_is_inside) {
     return 0;
   }
-  if (trans_grid.bounded_side(midpoint_diag_1) == CGAL::ON_BOUNDED_SIDE) {
+  if (diag_1_is_inside) {
     return 1;
   }
   std::cerr << "Invalid grid cell! At\n";
@@ -218,28 +270,6 @@ int InsetState::chosen_diag(
   exit(1);
 }
 
-void InsetState::fill_grid_diagonals(const bool project_original)
-{
-  // Initialize array if running for the first time
-  if (grid_diagonals_.shape()[0] != lx_ || grid_diagonals_.shape()[1] != ly_) {
-    grid_diagonals_.resize(boost::extents[lx_ - 1][ly_ - 1]);
-  }
-  unsigned int n_concave = 0;  // Count concave grid cells
-
-#pragma omp parallel for default(none) shared(n_concave, project_original)
-  for (unsigned int i = 0; i < lx_ - 1; ++i) {
-    for (unsigned int j = 0; j < ly_ - 1; ++j) {
-      Point v[4];
-      v[0] = Point(double(i) + 0.5, double(j) + 0.5);
-      v[1] = Point(double(i) + 1.5, double(j) + 0.5);
-      v[2] = Point(double(i) + 1.5, double(j) + 1.5);
-      v[3] = Point(double(i) + 0.5, double(j) + 1.5);
-      grid_diagonals_[i][j] = chosen_diag(v, n_concave, project_original);
-    }
-  }
-  std::cerr << "Number of concave grid cells: " << n_concave << std::endl;
-}
-
 std::array<Point, 3> InsetState::transformed_triangle(
   const std::array<Point, 3> &tri,
   const bool project_original) const
@@ -253,157 +283,36 @@ std::array<Point, 3> InsetState::transformed_triangle(
   return transf_tri;
 }
 
-// Determine if a point `pt` is on the boundary of a triangle by using cross
-// products to find areas spanned by pt and each triangle edge. Idea from:
-// https://stackoverflow.com/questions/7050186/find-if-point-lies-on-line-segment
-// This function is needed because, sometimes,
-// `triangle.bounded_side(Point(x, y)) == CGAL::ON_BOUNDARY` does not return
-// `true` even if the point is on the boundary.
-bool is_on_triangle_boundary(const Point &pt, const Polygon &triangle)
-{
-  for (unsigned int i = 0; i < triangle.size(); ++i) {
-    const auto t1 = triangle[i];
-    const auto t2 = triangle[(i == triangle.size() - 1) ? 0 : i + 1];
-    const double area = (t1.x() - pt.x()) * (t2.y() - pt.y()) -
-                        (t2.x() - pt.x()) * (t1.y() - pt.y());
-    if (almost_equal(area, 0.0)) {
-      return true;
-    }
-  }
-  return false;
-}
-
-// Get the untransformed coordinates of the triangle in which the point `pt`
-// is located. After transformation, this triangle must be entirely inside
-// the transformed grid cell.
-std::array<Point, 3> InsetState::untransformed_triangle(
-  const Point &pt,
-  const bool project_original) const
-{
-  if (pt.x() < 0 || pt.x() > lx_ || pt.y() < 0 || pt.y() > ly_) {
-    CGAL::set_pretty_mode(std::cerr);
-    std::cerr << "ERROR: coordinate outside bounding box in " << __func__
-              << "().\npt = " << pt << std::endl;
-    exit(1);
-  }
-
-  // Get original grid coordinates
-  Point v[4];
-  v[0] = Point(
-    std::max(0.0, floor(pt.x() + 0.5) - 0.5),
-    std::max(0.0, floor(pt.y() + 0.5) - 0.5));
-  v[1] = Point(
-    std::min(static_cast<double>(lx_), floor(pt.x() + 0.5) + 0.5),
-    v[0].y());
-  v[2] = Point(
-    v[1].x(),
-    std::min(static_cast<double>(ly_), floor(pt.y() + 0.5) + 0.5));
-  v[3] = Point(v[0].x(), v[2].y());
-
-  // TODO: diag SEEMS TO BE MORE NATURALLY THOUGHT OF AS bool INSTEAD OF int.
-  // Assuming that the transformed grid does not have self-intersections,
-  // at least one of the diagonals must be completely inside the grid.
-  // We use that diagonal to split the grid into two triangles.
-  int diag;
-  if (
-    v[0].x() == 0.0 || v[0].y() == 0.0 || v[2].x() == lx_ || v[2].y() == ly_) {
-
-    // Case when the grid is on the edge of the grid.
-    // We calculate the chosen diagonal because grid_diagonals_ does not
-    // store the diagonals for edge grid cells.
-    unsigned int n_concave = 0;
-    diag = chosen_diag(v, n_concave, project_original);
-  } else {
-
-    // Case when the grid is not on the edge of the grid. We can find the
-    // already computed chosen diagonal in grid_diagonals_.
-    const auto x = static_cast<unsigned int>(v[0].x());
-    const auto y = static_cast<unsigned int>(v[0].y());
-    diag = grid_diagonals_[x][y];
-  }
-
-  // Get the two possible triangles
-  Polygon triangle1;
-  Polygon triangle2;
-  if (diag == 0) {
-    triangle1.push_back(v[0]);
-    triangle1.push_back(v[1]);
-    triangle1.push_back(v[2]);
-    triangle2.push_back(v[0]);
-    triangle2.push_back(v[2]);
-    triangle2.push_back(v[3]);
-  } else {
-    triangle1.push_back(v[0]);
-    triangle1.push_back(v[1]);
-    triangle1.push_back(v[3]);
-    triangle2.push_back(v[1]);
-    triangle2.push_back(v[2]);
-    triangle2.push_back(v[3]);
-  }
-
-  // Determine which untransformed triangle the given point is in. If the
-  // point is in neither, an error is raised.
-  std::array<Point, 3> triangle_coordinates;
-  if (
-    (triangle1.bounded_side(pt) == CGAL::ON_BOUNDED_SIDE) ||
-    is_on_triangle_boundary(pt, triangle1)) {
-    for (unsigned int i = 0; i < triangle1.size(); ++i) {
-      triangle_coordinates[i] = triangle1[i];
-    }
-  } else if (
-    (triangle2.bounded_side(pt) == CGAL::ON_BOUNDED_SIDE) ||
-    is_on_triangle_boundary(pt, triangle2)) {
-    for (unsigned int i = 0; i < triangle2.size(); ++i) {
-      triangle_coordinates[i] = triangle2[i];
-    }
-  } else {
-    std::cerr << "Point not in grid cell!\n";
-    std::cerr << "Point coordinates:\n";
-    std::cerr << "(" << pt.x() << ", " << pt.y() << ")\n";
-    std::cerr << "Original grid cell:\n";
-    std::cerr << "(" << v[0].x() << ", " << v[0].y() << ")\n";
-    std::cerr << "(" << v[1].x() << ", " << v[1].y() << ")\n";
-    std::cerr << "(" << v[2].x() << ", " << v[2].y() << ")\n";
-    std::cerr << "(" << v[3].x() << ", " << v[3].y() << ")\n";
-    std::cerr << "Chosen diagonal: " << diag << "\n";
-    exit(1);
-  }
-  return triangle_coordinates;
-}
-
-Point affine_trans(
+// For each point, we make the following transformation. Suppose we find
+// that, before the cartogram transformation, a point (x, y) is in the
+// triangle (a, b, c). We want to find its position in the projected
+// triangle (p, q, r). We locally approximate the cartogram transformation
+// by an affine transformation T such that T(a) = p, T(b) = q and T(c) = r.
+// We can think of T as a 3x3 matrix
+//    -----------
+//   |t11 t12 t13|
+//   |t21 t22 t23|  such that
+//   | 0   0   1 |
+//    -----------
+//    -----------   ----------     ----------
+//   |t11 t12 t13| | a1 b1 c1 |   | p1 q1 r1 |
+//   |t21 t22 t23| | a2 b2 c2 | = | p2 q2 r2 | or TA = P.
+//   | 0   0   1 | | 1  1  1  |   |  1  1  1 |
+//    -----------   ----------     ----------
+// Hence, T = PA^{-1}.
+//                              -----------------------
+//                             |b2-c2 c1-b1 b1*c2-b2*c1|
+// We have A^{-1} = (1/det(A)) |c2-a2 a1-c1 a2*c1-a1*c2|. By multiplying
+//                             |a2-b2 b1-a1 a1*b2-a2*b1|
+//                              -----------------------
+// PA^{-1} we obtain t11, t12, t13, t21, t22, and t23. If the original
+// coordinates are (x, y) on the unprojected map, then the transformed
+// coordinates are:
+// post.x = t11*x + t12*y + t13, post.y = t21*x + t22*y + t23.
+std::array<double, 6> affine_transformation(
   const std::array<Point, 3> &tri,
-  const std::array<Point, 3> &org_tri,
-  const Point &pt)
+  const std::array<Point, 3> &org_tri)
 {
-  // For each point, we make the following transformation. Suppose we find
-  // that, before the cartogram transformation, a point (x, y) is in the
-  // triangle (a, b, c). We want to find its position in the projected
-  // triangle (p, q, r). We locally approximate the cartogram transformation
-  // by an affine transformation T such that T(a) = p, T(b) = q and T(c) = r.
-  // We can think of T as a 3x3 matrix
-  //    -----------
-  //   |t11 t12 t13|
-  //   |t21 t22 t23|  such that
-  //   | 0   0   1 |
-  //    -----------
-  //    -----------   ----------     ----------
-  //   |t11 t12 t13| | a1 b1 c1 |   | p1 q1 r1 |
-  //   |t21 t22 t23| | a2 b2 c2 | = | p2 q2 r2 | or TA = P.
-  //   | 0   0   1 | | 1  1  1  |   |  1  1  1 |
-  //    -----------   ----------     ----------
-  // Hence, T = PA^{-1}.
-  //                              -----------------------
-  //                             |b2-c2 c1-b1 b1*c2-b2*c1|
-  // We have A^{-1} = (1/det(A)) |c2-a2 a1-c1 a2*c1-a1*c2|. By multiplying
-  //                             |a2-b2 b1-a1 a1*b2-a2*b1|
-  //                              -----------------------
-  // PA^{-1} we obtain t11, t12, t13, t21, t22, and t23. If the original
-  // coordinates are (x, y) on the unprojected map, then the transformed
-  // coordinates are:
-  // post.x = t11*x + t12*y + t13, post.y = t21*x + t22*y + t23.
-  const Point pre(pt.x(), pt.y());
-
   // Old triangle (a, b, c) expressed as matrix A
   const Matrix abc_mA(org_tri[0], org_tri[1], org_tri[2]);
 
@@ -412,25 +321,88 @@ Point affine_trans(
 
   // Transformation matrix T
   const auto mT = pqr_mP.multiplied_with(abc_mA.inverse());
-
-  // Transformed point
-  return mT.transformed_point(pre);
+  return {mT.p11, mT.p12, mT.p13, mT.p21, mT.p22, mT.p23};
 }
 
-Point InsetState::projected_point_with_triangulation(
-  const Point &pt,
-  const bool project_original) const
+// Choose the diagonal of each grid cell, including the half cells at the
+// edges of the lattice, and store the affine transformations of the two
+// triangles into which it splits the cell. Afterwards,
+// projected_point_with_triangulation() only needs a table lookup and
+// closed-form arithmetic per point.
+void InsetState::fill_grid_diagonals(const bool project_original)
 {
-  // Get the untransformed triangle the point pt is in
-  const auto old_triangle = untransformed_triangle(pt, project_original);
+  unsigned int n_concave = 0;  // Count concave grid cells
 
-  // Get the coordinates of the transformed triangle
-  const auto new_triangle =
-    transformed_triangle(old_triangle, project_original);
+#pragma omp parallel for default(none) shared(project_original) \
+  reduction(+ : n_concave)
+  for (unsigned int i = 0; i <= lx_; ++i) {
+    for (unsigned int j = 0; j <= ly_; ++j) {
 
-  // Get the transformed point and return it
-  const auto transformed_pt = affine_trans(new_triangle, old_triangle, pt);
-  return rounded_point(transformed_pt, lx_, ly_);
+      // Corners of the grid cell centred at (i, j), clipped to the lattice
+      Point v[4];
+      v[0] = Point(std::max(0.0, i - 0.5), std::max(0.0, j - 0.5));
+      v[1] = Point(std::min(static_cast<double>(lx_), i + 0.5), v[0].y());
+      v[2] = Point(v[1].x(), std::min(static_cast<double>(ly_), j + 0.5));
+      v[3] = Point(v[0].x(), v[2].y());
+
+      // Assuming that the transformed grid does not have self-intersections,
+      // at least one of the diagonals must be completely inside the grid.
+      // We use that diagonal to split the grid into two triangles.
+      const int diag = chosen_diag(v, n_concave, project_original);
+      grid_diagonals_[i][j] = diag;
+      const std::array<std::array<Point, 3>, 2> triangles =
+        (diag == 0) ? std::array<std::array<Point, 3>, 2>{{
+                        {v[0], v[1], v[2]},
+                        {v[0], v[2], v[3]}}}
+                    : std::array<std::array<Point, 3>, 2>{{
+                        {v[0], v[1], v[3]},
+                        {v[1], v[2], v[3]}}};
+      for (unsigned int k = 0; k < 2; ++k) {
+        triangle_transformations_[i][j][k] = affine_transformation(
+          transformed_triangle(triangles[k], project_original),
+          triangles[k]);
+      }
+    }
+  }
+  std::cerr << "Number of concave grid cells: " << n_concave << std::endl;
+}
+
+// Project a point with the affine transformation of the triangle in which
+// it is located. fill_grid_diagonals() must have been called for the
+// current projection.
+Point InsetState::projected_point_with_triangulation(const Point &pt) const
+{
+  if (pt.x() < 0 || pt.x() > lx_ || pt.y() < 0 || pt.y() > ly_) {
+    CGAL::set_pretty_mode(std::cerr);
+    std::cerr << "ERROR: coordinate outside bounding box in " << __func__
+              << "().\npt = " << pt << std::endl;
+    exit(1);
+  }
+
+  // Grid cell and its corners v[0] = (x0, y0) and v[2] = (x2, y2)
+  const auto i = static_cast<unsigned int>(floor(pt.x() + 0.5));
+  const auto j = static_cast<unsigned int>(floor(pt.y() + 0.5));
+  const double x0 = std::max(0.0, i - 0.5);
+  const double y0 = std::max(0.0, j - 0.5);
+  const double x2 = std::min(static_cast<double>(lx_), i + 0.5);
+  const double y2 = std::min(static_cast<double>(ly_), j + 0.5);
+
+  // The sign of the cross product tells us on which side of the diagonal
+  // the point lies. The first triangle contains v[1] = (x2, y0). Points on
+  // the diagonal are assigned to the first triangle.
+  const double w = x2 - x0;
+  const double h = y2 - y0;
+  const bool in_first_triangle =
+    (grid_diagonals_[i][j] == 0)
+      ? (w * (pt.y() - y0) - h * (pt.x() - x0) <= 0.0)
+      : (h * (x2 - pt.x()) - w * (pt.y() - y0) >= 0.0);
+  const auto &t = triangle_transformations_[i][j][in_first_triangle ? 0 : 1];
+  return rounded_point(
+    Point(
+      t[0] * pt.x() + t[1] * pt.y() + t[2],
+      t[3] * pt.x() + t[4] * pt.y() + t[5]),
+    lx_,
+    ly_);
 }
 
 void InsetState::project_with_triangulation()
@@ -439,7 +411,7 @@ void InsetState::project_with_triangulation()
   // projected_point_with_triangulation
   // https://www.nextptr.com/tutorial/ta1430524603/
   // capture-this-in-lambda-expression-timeline-of-change
-  std::function<Point(Point)> lambda = [&](Point p1) {
+  const auto lambda = [&](Point p1) {
     return projected_point_with_triangulation(p1);
   };
 
@@ -450,39 +422,37 @@ void InsetState::project_with_triangulation()
 #pragma omp parallel for default(none)
   for (unsigned int i = 0; i < lx_; ++i) {
     for (unsigned int j = 0; j < ly_; ++j) {
-      cum_proj_[i][j] = projected_point_with_triangulation(cum_proj_[i][j]);
+      cum_proj_.set(
+        i,
+        j,
+        projected_point_with_triangulation(cum_proj_(i, j)));
     }
   }
 }
 
 void InsetState::project_with_cum_proj()
 {
-  std::function<Point(Point)> lambda = [&](Point p1) {
-    return projected_point_with_triangulation(p1, true);
+  const auto lambda = [&](Point p1) {
+    return projected_point_with_triangulation(p1);
   };
 
   // Transforming all points based on triangulation
   transform_points(lambda, true);
 }
 
-Point interpolate_point_with_proj_sequence(
-  Point p,
-  const std::vector<proj_qd> &proj_sequence_)
+void InsetState::project_with_cum_proj_qd()
 {
-  for (const auto &prj_qd : proj_sequence_) {
-    auto &dt = prj_qd.dt;
-    auto &proj_map = prj_qd.triangle_transformation;
-    p = interpolate_point_with_barycentric_coordinates(p, dt, proj_map);
+  // Without any integration, the cumulative projection is the identity
+  if (cum_proj_qd_.dt.number_of_vertices() == 0) {
+    return;
   }
-  return p;
-}
-
-void InsetState::project_with_proj_sequence()
-{
-  std::function<Point(Point)> lambda = [&](Point p1) {
-    return interpolate_point_with_proj_sequence(p1, proj_sequence_);
+  const auto lambda = [&dt = cum_proj_qd_.dt](const std::span<Point> ring) {
+    Face_handle hint;
+    for (auto &p : ring) {
+      p = interpolate_point_with_barycentric_coordinates(p, dt, hint);
+    }
   };
 
   // Apply the function on the original points
-  transform_points(lambda, true);
+  transform_rings(lambda, true);
 }
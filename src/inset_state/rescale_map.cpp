@@ -77,6 +77,7 @@ void InsetState::rescale_map(
       }
     }
   }
+  invalidate_geometry_caches();
 
   // Transformed Bounding Box:
   std::cerr << "New bounding box: " << bbox() << std::endl;
@@ -113,4 +114,5 @@ void InsetState::normalize_inset_area(
       }
     }
   }
+  invalidate_geometry_caches();
 }
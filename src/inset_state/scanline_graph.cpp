@@ -1,164 +1,291 @@
 #include "inset_state.hpp"
 
-// TODO: THE OUTPUT FROM intersec_with_parallel_to() ALWAYS
-// SEEM TO COME WITH A NEED TO SORT AFTERWARDS. SHOULD SORTING BECOME PART of
-// intersec_with_parallel_to() TO SAVE TYPING ELSEWHERE?
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-std::vector<std::vector<intersection> > InsetState::intersec_with_parallel_to(
+// Edge of a polygon ring in the active-edge table of
+// intersec_with_parallel_to(). The edge crosses the rays with indices
+// first_ray, ..., last_ray in the table of ray coordinates.
+struct scanline_edge {
+  Point curr_point;
+  Point prev_point;
+  unsigned int first_ray;
+  unsigned int last_ray;
+};
+
+// The function sweeps the rays across each polygon with holes with an
+// active-edge table. The edges are sorted by the first ray that they cross.
+// While sweeping the rays in ascending order, an edge becomes active at its
+// first ray and is dropped after its last ray. Thus, the cost is
+// O(edges * log(edges) + intersections) instead of
+// O(rays * edges) for testing every edge against every ray. The polygons
+// with holes are distributed among the OpenMP threads.
+std::vector<std::vector<intersection> > InsetState::scanlines_parallel_to(
   char axis,
   unsigned int resolution) const
 {
-  if (axis != 'x' && axis != 'y') {
-    std::cerr << "Invalid axis in " << __func__ << "()" << std::endl;
-    exit(984320);
-  }
   const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
   const unsigned int n_rays = grid_length * resolution;
-  std::vector<std::vector<intersection> > scanlines(n_rays);
-
-  // Iterate over GeoDivs in inset_state
-  for (const auto &gd : geo_divs_) {
-
-    // Find target density
-    const double target_density = target_areas_.at(gd.id()) / gd.area();
-
-    // Iterate over "polygons with holes" in inset_state
-    for (const auto &pwh : gd.polygons_with_holes()) {
-      const Bbox bb = pwh.bbox();
-      double min_lim, max_lim;
-      if (axis == 'x') {
-        min_lim = bb.ymin();
-        max_lim = bb.ymax();
-      } else {
-        min_lim = bb.xmin();
-        max_lim = bb.xmax();
+
+  // Table of ray coordinates and the corresponding indices in `scanlines`.
+  // The coordinates are accumulated in the same way as in the loops over
+  // the rays in fill_with_density(), so that they are bit-identical.
+  std::vector<double> rays;
+  std::vector<unsigned int> ray_indices;
+  rays.reserve(n_rays);
+  ray_indices.reserve(n_rays);
+  for (unsigned int k = 0; k < grid_length; ++k) {
+    for (double ray = k + 0.5 / resolution; ray < k + 1;
+         ray += (1.0 / resolution)) {
+      rays.push_back(ray);
+      ray_indices.push_back(static_cast<unsigned int>(
+        round((ray - 0.5 / resolution) * resolution)));
+    }
+  }
+
+  // We add a small value `epsilon` to the ray coordinate so that we assign
+  // correct densities if the ray with equation y = ray_y or x = ray_x goes
+  // exactly through a vertex. The addition ensures that, if there is any
+  // intersection, it is only counted once. This method also correctly
+  // detects whether the ray touches the point without entering or exiting
+  // the polygon.
+  const double epsilon = 1e-6 / resolution;
+
+  // Index of the first ray with coordinate >= v (if strict is false) or
+  // > v (if strict is true). The rays are almost equally spaced, so we start
+  // from the index of the nearest ray and correct it by at most a few steps
+  // instead of searching the whole table.
+  const auto n_table = static_cast<unsigned int>(rays.size());
+  auto first_ray_from = [&](const double v, const bool strict) {
+    const double guess = strict ? floor(v * resolution - 0.5) + 1
+                                : ceil(v * resolution - 0.5);
+    auto r = static_cast<unsigned int>(
+      std::clamp(guess, 0.0, static_cast<double>(n_table)));
+    auto below = [&](const unsigned int i) {
+      return strict ? rays[i] <= v : rays[i] < v;
+    };
+    while (r > 0 && !below(r - 1)) {
+      --r;
+    }
+    while (r < n_table && below(r)) {
+      ++r;
+    }
+    return r;
+  };
+
+  // Polygons with holes in the order of the GeoDivs in geo_divs_ and the
+  // number of vertices before each of them
+  std::vector<std::pair<unsigned int, const Polygon_with_holes *> > work;
+  std::vector<std::size_t> vertices_before{0};
+  for (unsigned int gd_index = 0; gd_index < geo_divs_.size(); ++gd_index) {
+    for (const auto &pwh : geo_divs_[gd_index].polygons_with_holes()) {
+      std::size_t n_vertices = pwh.outer_boundary().size();
+      for (const auto &h : pwh.holes()) {
+        n_vertices += h.size();
       }
+      work.emplace_back(gd_index, &pwh);
+      vertices_before.push_back(vertices_before.back() + n_vertices);
+    }
+  }
 
-      // Iterate over coordinates in bounding box of pwh
-      for (unsigned int k = static_cast<unsigned int>(floor(min_lim)) - 1;
-           k <= ceil(max_lim) + 1;
-           ++k) {
-
-        // If the rays are in x-direction, iterate over each ray between the
-        // grid lines y = k and y = k+1. Otherwise, iterate over each
-        // ray between x = k and x = k+1.
-        for (double ray = k + 0.5 / resolution; ray < k + 1;
-             ray += (1.0 / resolution)) {
-
-          // Temporary vector of intersections for this particular ray
-          std::vector<intersection> intersections;
-
-          // The following algorithm works by iterating over "resolution" rays
-          // in each cell. // For each ray, we iterate over each edge in a
-          // polygon and store all intersections. Afterward, we add the
-          // appropriate densities. We add a small value `epsilon` to the ray
-          // coordinate so that we assign correct densities if the ray with
-          // equation y = ray_y or x = ray_x goes exactly through curr_point.
-          // The addition ensures that, if there is any intersection, it is
-          // only counted once. This method also correctly detects whether the
-          // ray touches the point without entering or exiting the polygon.
-          const double epsilon = 1e-6 / resolution;
-
-          // Run algorithm on exterior ring
-          add_intersections(
-            intersections,
-            pwh.outer_boundary(),
-            ray,
-            target_density,
-            epsilon,
-            gd.id(),
-            axis);
-
-          // Run algorithm on each hole
-          for (const auto &h : pwh.holes()) {
-            add_intersections(
-              intersections,
-              h,
-              ray,
-              target_density,
-              epsilon,
-              gd.id(),
-              axis);
-          }
+  // Each thread scans a contiguous range of polygons with holes with about
+  // the same number of vertices and stores the intersections in its own
+  // scanlines. Hence, no locks are needed. Because the ranges are
+  // contiguous, concatenating the threads' scanlines in the order of the
+  // threads gives the same result as a serial scan.
+  std::vector<std::vector<std::vector<intersection> > > thread_scanlines;
 
-          // Check whether the number of intersections is odd
-          if (intersections.size() % 2 != 0) {
-            std::cerr << "Incorrect Topology.\n"
-                      << "Number of intersections: " << intersections.size()
-                      << "\n"
-                      << axis << "-coordinate: " << ray << "\n"
-                      << "Intersection points: " << std::endl;
-
-            for (auto &intersection : intersections) {
-              std::cerr << (axis == 'x' ? intersection.x() : intersection.y())
-                        << std::endl;
-            }
-            std::cerr << std::endl << std::endl;
-            _Exit(932875);
-          }
-          std::sort(intersections.begin(), intersections.end());
-
-          // Assign directions to intersections and add sorted vector of
-          // intersections to vector `scanlines`
-          const auto index = static_cast<unsigned int>(
-            round((ray - 0.5 / resolution) * resolution));
-          for (unsigned int l = 0; l < intersections.size(); ++l) {
-            intersections[l].ray_enters = (l % 2 == 0);
-            scanlines[index].push_back(intersections[l]);
+#pragma omp parallel default(none) shared( \
+    axis,                                  \
+      epsilon,                             \
+      first_ray_from,                      \
+      n_rays,                              \
+      ray_indices,                         \
+      rays,                                \
+      std::cerr,                           \
+      thread_scanlines,                    \
+      vertices_before,                     \
+      work)
+  {
+#ifdef _OPENMP
+    const auto n_threads = static_cast<unsigned int>(omp_get_num_threads());
+    const auto thread = static_cast<unsigned int>(omp_get_thread_num());
+#else
+    const unsigned int n_threads = 1;
+    const unsigned int thread = 0;
+#endif
+
+#pragma omp single
+    thread_scanlines.resize(n_threads);
+
+    // Range of polygons with holes for this thread
+    auto first_work_item = [&](const unsigned int t) {
+      const std::size_t target = vertices_before.back() * t / n_threads;
+      return static_cast<std::size_t>(
+        std::lower_bound(
+          vertices_before.begin(),
+          vertices_before.end() - 1,
+          target) -
+        vertices_before.begin());
+    };
+    const std::size_t work_begin = first_work_item(thread);
+    const std::size_t work_end =
+      (thread + 1 == n_threads) ? work.size() : first_work_item(thread + 1);
+    auto &own_scanlines = thread_scanlines[thread];
+    own_scanlines.resize(n_rays);
+
+    // Scratch vectors. They are reused for all polygons with holes of this
+    // thread to avoid repeated allocations.
+    std::vector<scanline_edge> edges;
+    std::vector<scanline_edge> active_edges;
+    std::vector<intersection> intersections;
+
+    // Add the edges of a ring that cross at least one ray to `edges`.
+    // Edges parallel to the rays are ignored (grazing incidence).
+    auto add_edges = [&](const Polygon &ring) {
+      Point prev_point = ring[ring.size() - 1];
+      for (const auto &curr_point : ring) {
+        const double a = (axis == 'x' ? curr_point.y() : curr_point.x());
+        const double b = (axis == 'x' ? prev_point.y() : prev_point.x());
+        if (a != b) {
+          const unsigned int first = first_ray_from(std::min(a, b), false);
+          const unsigned int end = first_ray_from(std::max(a, b), true);
+          if (first < end) {
+            edges.push_back({curr_point, prev_point, first, end - 1});
           }
         }
+        prev_point = curr_point;
       }
-    }
-  }
-  return scanlines;
-}
+    };
 
-// Creates continuity/adjacency graph using horizontal and vertical scans
-void InsetState::create_contiguity_graph(unsigned int resolution)
-{
-  // Calculate horizontal and vertical scanlines
-  for (char axis : {'x', 'y'}) {
-    const std::vector<std::vector<intersection> > scanlines =
-      intersec_with_parallel_to(axis, resolution);
-    const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
+    // The intersections store the index of the GeoDiv in geo_divs_
+    for (std::size_t w = work_begin; w < work_end; ++w) {
+      const unsigned int gd_index = work[w].first;
+      const Polygon_with_holes &pwh = *work[w].second;
 
-    // Iterate over rows (if axis is 'x') or columns
-    for (unsigned int k = 0; k < grid_length; ++k) {
+      // Build the edge table of the exterior ring and the holes
+      edges.clear();
+      add_edges(pwh.outer_boundary());
+      for (const auto &h : pwh.holes()) {
+        add_edges(h);
+      }
+      std::sort(
+        edges.begin(),
+        edges.end(),
+        [](const scanline_edge &e1, const scanline_edge &e2) {
+          return e1.first_ray < e2.first_ray;
+        });
 
-      // Iterate over rays in this row or column
-      for (double ray = k + 0.5 / resolution; ray < k + 1;
-           ray += (1.0 / resolution)) {
+      // Sweep the rays
+      active_edges.clear();
+      std::size_t next_edge = 0;
+      unsigned int r = 0;  // Index of the current ray in `rays`
+      while (next_edge < edges.size() || !active_edges.empty()) {
 
-        // Intersections for one ray
-        std::vector<intersection> intersections =
-          scanlines[static_cast<unsigned int>(
-            round((ray - (0.5 / resolution) * resolution)))];
+        // If no edge is active, skip the rays up to the next edge
+        if (active_edges.empty()) {
+          r = edges[next_edge].first_ray;
+        }
 
-        // Sort intersections in ascending order
-        sort(intersections.begin(), intersections.end());
-        const int size = static_cast<int>(intersections.size()) - 1;
-
-        // Find adjacent GeoDivs by iterating over intersections
-        for (int l = 1; l < size; l += 2) {
-          const double coord_1 = intersections[l].x();
-          const double coord_2 = intersections[l + 1].x();
-          const std::string gd_1 = intersections[l].geo_div_id;
-          const std::string gd_2 = intersections[l + 1].geo_div_id;
-
-          // Update adjacency
-          if (gd_1 != gd_2 && coord_1 == coord_2) {
-            for (auto &gd : geo_divs_) {
-              if (gd.id() == gd_1) {
-                gd.adjacent_to(gd_2);
-              } else if (gd.id() == gd_2) {
-                gd.adjacent_to(gd_1);
-              }
-            }
+        // Activate the edges whose first ray is r
+        while (next_edge < edges.size() && edges[next_edge].first_ray == r) {
+          active_edges.push_back(edges[next_edge]);
+          ++next_edge;
+        }
+
+        // Intersections of the active edges with the ray. Every active edge
+        // intersects the ray.
+        intersections.clear();
+        for (const auto &e : active_edges) {
+          intersection temp;
+          if (temp.ray_intersects(
+                e.curr_point,
+                e.prev_point,
+                rays[r],
+                epsilon,
+                axis == 'x')) {
+            temp.geo_div = gd_index;
+            intersections.push_back(temp);
+          }
+        }
+
+        // Check whether the number of intersections is odd
+        if (intersections.size() % 2 != 0) {
+          std::cerr << "Incorrect Topology.\n"
+                    << "Number of intersections: " << intersections.size()
+                    << "\n"
+                    << axis << "-coordinate: " << rays[r] << "\n"
+                    << "Intersection points: " << std::endl;
+
+          for (auto &intersection : intersections) {
+            std::cerr << (axis == 'x' ? intersection.x() : intersection.y())
+                      << std::endl;
           }
+          std::cerr << std::endl << std::endl;
+          _Exit(932875);
+        }
+        std::sort(intersections.begin(), intersections.end());
+
+        // Assign directions to intersections and add sorted vector of
+        // intersections to the scanlines of this thread
+        auto &scanline = own_scanlines[ray_indices[r]];
+        for (unsigned int l = 0; l < intersections.size(); ++l) {
+          intersections[l].ray_enters = (l % 2 == 0);
+          scanline.push_back(intersections[l]);
         }
+
+        // Drop the edges whose last ray is r and go to the next ray
+        std::erase_if(active_edges, [r](const scanline_edge &e) {
+          return e.last_ray == r;
+        });
+        ++r;
       }
     }
   }
+
+  // Concatenate the scanlines of the threads and sort the intersections of
+  // each ray in ascending order, so that callers can read the cached
+  // scanlines without copying them. The rays are independent of each other,
+  // so they are merged in parallel.
+  std::vector<std::vector<intersection> > scanlines =
+    std::move(thread_scanlines[0]);
+
+#pragma omp parallel for default(none) \
+  shared(n_rays, scanlines, thread_scanlines)
+  for (unsigned int i = 0; i < n_rays; ++i) {
+    for (std::size_t t = 1; t < thread_scanlines.size(); ++t) {
+      scanlines[i].insert(
+        scanlines[i].end(),
+        thread_scanlines[t][i].begin(),
+        thread_scanlines[t][i].end());
+    }
+    std::sort(scanlines[i].begin(), scanlines[i].end());
+  }
+  return scanlines;
+}
+
+// Looks up the scanlines in scanline_cache_ and only computes them if the
+// geometry changed since they were cached. fill_with_density() and
+// write_intersections_image() often scan the same geometry.
+const std::vector<std::vector<intersection> > &InsetState::
+  intersec_with_parallel_to(char axis, unsigned int resolution) const
+{
+  if (axis != 'x' && axis != 'y') {
+    std::cerr << "Invalid axis in " << __func__ << "()" << std::endl;
+    exit(984320);
+  }
+  std::erase_if(scanline_cache_, [this](const auto &entry) {
+    return std::get<2>(entry.first) != geometry_generation_;
+  });
+  const auto key = std::make_tuple(axis, resolution, geometry_generation_);
+  auto it = scanline_cache_.find(key);
+  if (it == scanline_cache_.end()) {
+    it = scanline_cache_
+           .emplace(key, scanlines_parallel_to(axis, resolution))
+           .first;
+  }
+  return it->second;
 }
 
 // Returns line segments highlighting intersection points using scans above
@@ -167,7 +294,7 @@ std::vector<Segment> InsetState::intersecting_segments(
 {
   std::vector<Segment> int_segments;
   for (char axis : {'x', 'y'}) {
-    const std::vector<std::vector<intersection> > scanlines =
+    const std::vector<std::vector<intersection> > &scanlines =
       intersec_with_parallel_to(axis, resolution);
     const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
 
@@ -178,14 +305,11 @@ std::vector<Segment> InsetState::intersecting_segments(
       for (double ray = k + 0.5 / resolution; ray < k + 1;
            ray += (1.0 / resolution)) {
 
-        // Intersections for one ray
-        std::vector<intersection> intersec =
+        // Intersections for one ray, sorted in ascending order
+        const std::vector<intersection> &intersec =
           scanlines[static_cast<unsigned int>(
             round((ray - (0.5 / resolution) * resolution)))];
 
-        // Sort intersections in ascending order
-        std::sort(intersec.begin(), intersec.end());
-
         // Check whether intersection enters twice or exits twice
         for (size_t l = 0; l + 1 < intersec.size(); ++l) {
           if (
@@ -0,0 +1,146 @@
+#include "inset_state.hpp"
+#include "interpolate_bilinearly.hpp"
+
+// All arrays whose size depends on the lattice dimensions lx_ and ly_ are
+// allocated, resized, and released by the functions in this file. Thus, a
+// change of lx_ and ly_ cannot leave an array with stale dimensions.
+
+void InsetState::set_up_grid()
+{
+  // Fourier transforms. FTReal2d::allocate() releases any previous array.
+  rho_init_.allocate(lx_, ly_);
+  rho_ft_.allocate(lx_, ly_);
+  grid_fluxx_init_.allocate(lx_, ly_);
+  grid_fluxy_init_.allocate(lx_, ly_);
+
+  // The plans are cached per grid shape. Hence, only the first inset with a
+  // given shape pays the planning cost.
+  make_fftw_plans_for_rho();
+  make_fftw_plans_for_flux();
+
+  // Projections, scratch arrays of the integrator and triangulation of the
+  // grid cells
+  proj_.resize(lx_, ly_);
+  mid_.resize(lx_, ly_);
+  v_intp_.resize(lx_, ly_);
+  k2_.resize(lx_, ly_);
+  k3_.resize(lx_, ly_);
+  k4_.resize(lx_, ly_);
+  velocity_field_.allocate(lx_, ly_);
+  grid_diagonals_.resize(boost::extents[lx_ + 1][ly_ + 1]);
+  triangle_transformations_.resize(boost::extents[lx_ + 1][ly_ + 1]);
+
+  // Rasterized density. The next call of fill_with_density() must fill all
+  // grid cells.
+  rho_num_.resize(boost::extents[lx_][ly_]);
+  rho_den_.resize(boost::extents[lx_][ly_]);
+  exact_coverage_.reset(lx_, ly_);
+
+  // Quadtree and triangulation of the quadtree-Delaunay method. The root of
+  // the quadtree is the smallest square that contains the lattice and has
+  // the same centre. A leaf is split if it contains more than 9 points.
+  const double side = std::max(lx_, ly_);
+  quadtree_.reset(
+    0.5 * (lx_ - side),
+    0.5 * (ly_ - side),
+    side,
+    static_cast<unsigned int>(std::max(log2(lx_), log2(ly_))),
+    9);
+  unique_quadtree_corners_.clear();
+  proj_qd_.dt.clear();
+  initialize_identity_proj();
+  initialize_cum_proj();
+}
+
+void InsetState::free_grid()
+{
+  // The FFTW plans are owned by the plan cache. Only the arrays are ours.
+  rho_init_.free();
+  rho_ft_.free();
+  grid_fluxx_init_.free();
+  grid_fluxy_init_.free();
+  fwd_plan_for_rho_ = nullptr;
+  bwd_plan_for_rho_ = nullptr;
+  proj_.free();
+  cum_proj_.free();
+  identity_proj_.free();
+  mid_.free();
+  v_intp_.free();
+  k2_.free();
+  k3_.free();
+  k4_.free();
+  velocity_field_.free();
+  grid_diagonals_.resize(boost::extents[0][0]);
+  triangle_transformations_.resize(boost::extents[0][0]);
+  rho_num_.resize(boost::extents[0][0]);
+  rho_den_.resize(boost::extents[0][0]);
+  exact_coverage_.free();
+  vertex_shifts_ = {};
+  scanline_cache_.clear();
+  quadtree_.free();
+  unique_quadtree_corners_.clear();
+  proj_qd_.dt.clear();
+  cum_proj_qd_.dt.clear();
+}
+
+void InsetState::refine_grid(const unsigned int factor)
+{
+  const unsigned int old_lx = lx_;
+  const unsigned int old_ly = ly_;
+  const double f = factor;
+
+  // Displacement of the cumulative projection on the old lattice
+  boost::multi_array<double, 2> xdisp(boost::extents[old_lx][old_ly]);
+  boost::multi_array<double, 2> ydisp(boost::extents[old_lx][old_ly]);
+
+#pragma omp parallel for default(none) shared(xdisp, ydisp, old_lx, old_ly)
+  for (unsigned int i = 0; i < old_lx; ++i) {
+    for (unsigned int j = 0; j < old_ly; ++j) {
+      xdisp[i][j] = cum_proj_.x(i, j) - i - 0.5;
+      ydisp[i][j] = cum_proj_.y(i, j) - j - 0.5;
+    }
+  }
+
+  // Reallocate all lattice-sized arrays for the finer lattice
+  lx_ *= factor;
+  ly_ *= factor;
+  set_up_grid();
+
+  // Resample the cumulative projection. The new lattice point (i+0.5, j+0.5)
+  // corresponds to the point ((i+0.5)/f, (j+0.5)/f) on the old lattice.
+  // Because the map is scaled by f, so is the interpolated displacement.
+#pragma omp parallel for default(none) \
+  shared(xdisp, ydisp, old_lx, old_ly, f)
+  for (unsigned int i = 0; i < lx_; ++i) {
+    for (unsigned int j = 0; j < ly_; ++j) {
+      const double old_x = (i + 0.5) / f;
+      const double old_y = (j + 0.5) / f;
+      const double intp_x =
+        interpolate_bilinearly(old_x, old_y, xdisp, 'x', old_lx, old_ly);
+      const double intp_y =
+        interpolate_bilinearly(old_x, old_y, ydisp, 'y', old_lx, old_ly);
+      cum_proj_.x(i, j) = i + 0.5 + f * intp_x;
+      cum_proj_.y(i, j) = j + 0.5 + f * intp_y;
+    }
+  }
+
+  // Rescale the map so that it covers the same fraction of the new lattice.
+  // The original GeoDivs must be rescaled as well because they are projected
+  // with cum_proj_ if the output is written to stdout.
+  const Transformation scale(CGAL::SCALING, f);
+  transform_points(scale);
+  transform_points(scale, true);
+
+  // Areas scale with the square of the factor
+  for (auto &[id, area] : target_areas_) {
+    area *= f * f;
+  }
+  initial_area_ *= f * f;
+
+  // Rescale the cumulative quadtree-Delaunay projection. Scaling preserves
+  // the Delaunay property, so we can move the vertices in place.
+  for (const auto vh : cum_proj_qd_.dt.finite_vertex_handles()) {
+    vh->set_point(Point(f * vh->point().x(), f * vh->point().y()));
+    vh->info() = Point(f * vh->info().x(), f * vh->info().y());
+  }
+}
@@ -90,5 +90,10 @@ void InsetState::simplify(const unsigned int target_points_per_inset)
       pwh = std::move(pgnwh);
     }
   }
+  invalidate_geometry_caches();
+
+  // The exact coverages of the GeoDivs were computed with the removed
+  // vertices
+  exact_coverage_.reset(lx_, ly_);
   std::cerr << n_points() << " points after simplification." << std::endl;
 }
\ No newline at end of file
@@ -269,19 +269,19 @@ void InsetState::write_polygons_on_surface(
     cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
 
     // Vertical grid lines
-    for (unsigned int i = 0; i <= lx_; i += grid_line_spacing) {
-      cairo_move_to(cr, cum_proj_[i][0].x(), ly_ - cum_proj_[i][0].y());
+    for (unsigned int i = 0; i < lx_; i += grid_line_spacing) {
+      cairo_move_to(cr, cum_proj_.x(i, 0), ly_ - cum_proj_.y(i, 0));
       for (unsigned int j = 1; j < ly_; ++j) {
-        cairo_line_to(cr, cum_proj_[i][j].x(), ly_ - cum_proj_[i][j].y());
+        cairo_line_to(cr, cum_proj_.x(i, j), ly_ - cum_proj_.y(i, j));
       }
       cairo_stroke(cr);
     }
 
     // Horizontal grid lines
-    for (unsigned int j = 0; j <= ly_; j += grid_line_spacing) {
-      cairo_move_to(cr, cum_proj_[0][j].x(), ly_ - cum_proj_[0][j].y());
+    for (unsigned int j = 0; j < ly_; j += grid_line_spacing) {
+      cairo_move_to(cr, cum_proj_.x(0, j), ly_ - cum_proj_.y(0, j));
       for (unsigned int i = 1; i < lx_; ++i) {
-        cairo_line_to(cr, cum_proj_[i][j].x(), ly_ - cum_proj_[i][j].y());
+        cairo_line_to(cr, cum_proj_.x(i, j), ly_ - cum_proj_.y(i, j));
       }
       cairo_stroke(cr);
     }
@@ -390,18 +390,16 @@ void InsetState::write_grid_heatmap_data(const std::string filename)
 
   InsetState is_copy = (*this);
   is_copy.set_geo_divs(geo_divs_original_);
-  auto intersections_with_rays =
+  const std::vector<std::vector<intersection>> &intersections_with_rays =
     is_copy.intersec_with_parallel_to('x', resolution);
   std::vector<std::vector<double>> exists(lx_, std::vector<double>(ly_, 0));
 
   // Mark all squares that are inside map with 1
   for (unsigned int y = 0; y < ly_; y += 1.0) {
 
-    // Intersections for one ray
-    auto intersections_at_y = intersections_with_rays[y];
-
-    // Sort intersections in ascending order
-    std::sort(intersections_at_y.begin(), intersections_at_y.end());
+    // Intersections for one ray, sorted in ascending order
+    const std::vector<intersection> &intersections_at_y =
+      intersections_with_rays[y];
 
     // Fill GeoDivs by iterating over intersections
     for (unsigned int i = 0; i < intersections_at_y.size(); i += 2) {
@@ -1091,27 +1089,26 @@ Polygon InsetState::grid_cell_edge_points(
   bool plot_equal_area_map = false)
 {
   Polygon cell_edge_points;
-  const boost::multi_array<Point, 2> &proj =
-    plot_equal_area_map ? identity_proj_ : cum_proj_;
+  const PointGrid &proj = plot_equal_area_map ? identity_proj_ : cum_proj_;
 
   // Horizontal lower edge points
   for (unsigned int i = x; i < x + cell_width; ++i) {
-    cell_edge_points.push_back(proj[i][y]);
+    cell_edge_points.push_back(proj(i, y));
   }
 
   // Vertical right edge points
   for (unsigned int i = y; i < y + cell_width; ++i) {
-    cell_edge_points.push_back(proj[x + cell_width][i]);
+    cell_edge_points.push_back(proj(x + cell_width, i));
   }
 
   // Horizontal upper edge points
   for (unsigned int i = x + cell_width; i > x; --i) {
-    cell_edge_points.push_back(proj[i][y + cell_width]);
+    cell_edge_points.push_back(proj(i, y + cell_width));
   }
 
   // Vertical left edge points
   for (unsigned int i = y + cell_width; i > y; --i) {
-    cell_edge_points.push_back(proj[x][i]);
+    cell_edge_points.push_back(proj(x, i));
   }
 
   // Complete the polygon by making the first and last point the same
@@ -1,8 +1,12 @@
 #include "cartogram_info.hpp"
 #include "constants.hpp"
+#include "fftw_planner.hpp"
 #include "parse_arguments.hpp"
 #include "progress_tracker.hpp"
 #include "time_tracker.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 int main(const int argc, const char *argv[])
 {
@@ -18,6 +22,19 @@ int main(const int argc, const char *argv[])
 
   // Target number of points to retain after simplification
   unsigned int target_points_per_inset;
+
+  // Number of OpenMP threads. Zero means "let the OpenMP runtime decide".
+  unsigned int n_threads;
+
+  // FFTW planner rigor and (optional) path to FFTW wisdom file
+  std::string fftw_planner, fftw_wisdom_file;
+
+  // Integrator for the equations of motion in flatten_density()
+  Integrator integrator;
+
+  // Rasterize the density from the exact area coverage of the grid cells
+  // instead of sampling the GeoDivs with rays
+  bool exact_coverage;
   bool world;  // World maps need special projections
 
   // If `triangulation` is true, we apply a cartogram projection method based
@@ -44,6 +61,11 @@ int main(const int argc, const char *argv[])
     visual_file_name,
     max_n_grid_rows_or_cols,
     target_points_per_inset,
+    n_threads,
+    fftw_planner,
+    fftw_wisdom_file,
+    integrator,
+    exact_coverage,
     world,
     triangulation,
     qtdt_method,
@@ -59,6 +81,37 @@ int main(const int argc, const char *argv[])
     min_polygon_area,
     plot_quadtree);
 
+  // Set the number of threads for the `#pragma omp` loops. The parallel loops
+  // only write to disjoint memory locations or use reductions whose result
+  // does not depend on the order of evaluation (minimum, maximum, logical
+  // AND, integer sums). Hence, the output does not depend on the number of
+  // threads.
+#ifdef _OPENMP
+  if (n_threads > 0) {
+    omp_set_num_threads(static_cast<int>(n_threads));
+  }
+  std::cerr << "Using " << omp_get_max_threads() << " OpenMP thread(s)"
+            << std::endl;
+#else
+  if (n_threads > 1) {
+    std::cerr << "WARNING: cartogram was built without OpenMP. "
+              << "Ignoring --threads " << n_threads << "." << std::endl;
+  }
+#endif
+
+  // Initialize FFTW threads and load wisdom. The number of threads must be
+  // set before this call.
+  set_up_fftw(fftw_planner, fftw_wisdom_file);
+
+  // Save FFTW wisdom, so that future runs can skip planning, and release the
+  // plans on every return from main(), including the early ones
+  struct FftwCleanUp {
+    ~FftwCleanUp()
+    {
+      clean_up_fftw();
+    }
+  } fftw_clean_up;
+
   // Initialize cart_info. It contains all the information about the cartogram
   // that needs to be handled by functions called from main().
   CartogramInfo cart_info(world, visual_file_name);
@@ -217,18 +270,8 @@ int main(const int argc, const char *argv[])
       inset_state.store_original_geo_divs();
     }
 
-    // Set up Fourier transforms
-    const unsigned int lx = inset_state.lx();
-    const unsigned int ly = inset_state.ly();
-    inset_state.ref_to_rho_init().allocate(lx, ly);
-    inset_state.ref_to_rho_ft().allocate(lx, ly);
-    inset_state.ref_to_fluxx_init().allocate(lx, ly);
-    inset_state.ref_to_fluxy_init().allocate(lx, ly);
-    inset_state.make_fftw_plans_for_rho();
-    inset_state.make_fftw_plans_for_flux();
-    inset_state.initialize_identity_proj();
-    inset_state.initialize_cum_proj();
-    inset_state.set_area_errors();
+    // Set up Fourier transforms and projections on the lx-by-ly lattice
+    inset_state.set_up_grid();
 
     // Store initial inset area to calculate area drift
     inset_state.store_initial_area();
@@ -263,10 +306,16 @@ int main(const int argc, const char *argv[])
 
     time_tracker.start("Integration Inset " + inset_pos);
 
+    // Area errors and area drift of the initial map. The loop condition,
+    // the logging and the progress tracker read them from the convergence
+    // report, which set_area_errors() updates after each integration.
+    inset_state.set_area_errors();
+    const convergence_report &report = inset_state.convergence();
+
     // Start map integration
     while (inset_state.n_finished_integrations() < max_integrations &&
-           (inset_state.max_area_error().value > max_permitted_area_error ||
-            std::abs(inset_state.area_drift() - 1.0) > 0.01)) {
+           (report.max_area_error.value > max_permitted_area_error ||
+            std::abs(report.area_drift - 1.0) > 0.01)) {
 
       std::cerr << "\nIntegration number "
                 << inset_state.n_finished_integrations() << std::endl;
@@ -305,7 +354,7 @@ int main(const int argc, const char *argv[])
 
       time_tracker.start("Fill with Density");
 
-      inset_state.fill_with_density(plot_density);
+      inset_state.fill_with_density(plot_density, exact_coverage);
 
       time_tracker.stop("Fill with Density");
 
@@ -318,7 +367,7 @@ int main(const int argc, const char *argv[])
       if (qtdt_method) {
         inset_state.flatten_density_with_node_vertices();
       } else {
-        inset_state.flatten_density();
+        inset_state.flatten_density(integrator);
       }
 
       time_tracker.stop("Flatten Density");
@@ -360,16 +409,20 @@ int main(const int argc, const char *argv[])
         inset_state.write_intersections_image(intersections_resolution);
       }
 
-      // Print area drift information
-      std::cerr << "Area drift: " << (inset_state.area_drift() - 1.0) * 100.0
-                << "%" << std::endl;
-
-      // Update area errors
+      // Update area errors and print convergence information
       inset_state.set_area_errors();
-      inset_state.adjust_grid();
-      std::cerr << "max. area err: " << inset_state.max_area_error().value
-                << ", GeoDiv: " << inset_state.max_area_error().geo_div
+      std::cerr << "Area drift: " << (report.area_drift - 1.0) * 100.0 << "%"
                 << std::endl;
+      inset_state.adjust_grid();
+      std::cerr << "max. area err: " << report.max_area_error.value
+                << ", GeoDiv: " << report.max_area_error.geo_div << std::endl;
+      std::cerr << "mean area err: " << report.mean_area_error
+                << ", RMS area err: " << report.rms_area_error << std::endl;
+      const auto &histogram = report.area_error_histogram;
+      std::cerr << "GeoDivs with area err < 0.1%: " << histogram[0]
+                << ", < 1%: " << histogram[1] << ", < 10%: " << histogram[2]
+                << ", < 100%: " << histogram[3] << ", >= 100%: "
+                << histogram[4] << std::endl;
       progress_tracker.print_progress_mid_integration(inset_state);
       inset_state.increment_integration();
     }
@@ -403,7 +456,7 @@ int main(const int argc, const char *argv[])
 
     if (output_to_stdout) {
       if (qtdt_method) {
-        inset_state.project_with_proj_sequence();
+        inset_state.project_with_cum_proj_qd();
       } else {
         inset_state.fill_grid_diagonals(true);
         inset_state.project_with_cum_proj();
@@ -411,12 +464,7 @@ int main(const int argc, const char *argv[])
     }
 
     // Clean up after finishing all Fourier transforms for this inset
-    inset_state.destroy_fftw_plans_for_rho();
-    inset_state.destroy_fftw_plans_for_flux();
-    inset_state.ref_to_rho_init().free();
-    inset_state.ref_to_rho_ft().free();
-    inset_state.ref_to_fluxx_init().free();
-    inset_state.ref_to_fluxy_init().free();
+    inset_state.free_grid();
 
     // End of inset time
     time_tracker.stop("Inset " + inset_pos);
@@ -0,0 +1,186 @@
+#include "exact_coverage.hpp"
+#include "constants.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+void ExactCoverage::reset(const unsigned int lx, const unsigned int ly)
+{
+  lx_ = lx;
+  ly_ = ly;
+  edges_.clear();
+  edge_begin_.clear();
+  coverages_.clear();
+}
+
+void ExactCoverage::free()
+{
+  edges_ = {};
+  edge_begin_ = {};
+  coverages_ = {};
+}
+
+void ExactCoverage::add_edge(
+  const double x_prev,
+  const double y_prev,
+  const double x_curr,
+  const double y_curr,
+  const double orientation)
+{
+  if (y_curr == y_prev) {
+    return;
+  }
+  if (y_curr < y_prev) {
+    edges_.push_back({x_curr, y_curr, x_prev, y_prev, orientation});
+  } else {
+    edges_.push_back({x_prev, y_prev, x_curr, y_curr, -orientation});
+  }
+}
+
+std::vector<unsigned int> ExactCoverage::regions_to_rasterize(
+  const std::size_t n_regions,
+  std::vector<double> &vertex_shifts)
+{
+  std::vector<unsigned int> regions;
+  if (coverages_.size() != n_regions) {
+    coverages_.assign(n_regions, {});
+    vertex_shifts.assign(n_regions, 0.0);
+    regions.resize(n_regions);
+    std::iota(regions.begin(), regions.end(), 0);
+    return regions;
+  }
+  for (unsigned int r = 0; r < n_regions; ++r) {
+    if (vertex_shifts[r] > refill_displacement_tolerance) {
+      regions.push_back(r);
+      vertex_shifts[r] = 0.0;
+    }
+  }
+  return regions;
+}
+
+std::vector<ExactCoverage::cell_area> ExactCoverage::rasterize(
+  const std::size_t begin,
+  const std::size_t end) const
+{
+  if (begin == end) {
+    return {};
+  }
+
+  // Grid cells i in [i_begin, i_end), j in [j_begin, j_end) that overlap
+  // the bounding box of the edges
+  double x_min = edges_[begin].x_lower, x_max = x_min;
+  double y_min = edges_[begin].y_lower, y_max = edges_[begin].y_upper;
+  for (std::size_t k = begin; k < end; ++k) {
+    const signed_edge &e = edges_[k];
+    x_min = std::min({x_min, e.x_lower, e.x_upper});
+    x_max = std::max({x_max, e.x_lower, e.x_upper});
+    y_min = std::min(y_min, e.y_lower);
+    y_max = std::max(y_max, e.y_upper);
+  }
+  const auto i_begin = static_cast<std::size_t>(floor(x_min));
+  const auto i_end = static_cast<std::size_t>(ceil(x_max));
+  const auto j_begin = static_cast<std::size_t>(floor(y_min));
+  const auto j_end = static_cast<std::size_t>(ceil(y_max));
+
+  // Accumulation array, stored row by row from the grid cell i_begin. A row
+  // has two extra elements because an edge on the right side x = i_end
+  // deposits up to the grid cell i_end+1. On the lattice boundary x = lx,
+  // that is the grid cell lx+1.
+  const std::size_t row_length = i_end - i_begin + 2;
+  std::vector<double> acc(row_length * (j_end - j_begin), 0.0);
+  for (std::size_t k = begin; k < end; ++k) {
+    const signed_edge &e = edges_[k];
+    const double dxdy = (e.x_upper - e.x_lower) / (e.y_upper - e.y_lower);
+    const auto j_first = static_cast<std::size_t>(floor(e.y_lower));
+    const auto j_last = static_cast<std::size_t>(ceil(e.y_upper));
+    for (std::size_t j = j_first; j < j_last; ++j) {
+      // Part of the edge inside the row j <= y <= j+1
+      const double y0 = std::max(static_cast<double>(j), e.y_lower);
+      const double y1 = std::min(j + 1.0, e.y_upper);
+      const double x_first =
+        (y0 == e.y_lower) ? e.x_lower : e.x_lower + dxdy * (y0 - e.y_lower);
+      const double x_last =
+        (y1 == e.y_upper) ? e.x_upper : e.x_lower + dxdy * (y1 - e.y_lower);
+      const double d = (y1 - y0) * e.sign;
+      double *row = acc.data() + (j - j_begin) * row_length;
+      const double x0 = std::min(x_first, x_last);
+      const double x1 = std::max(x_first, x_last);
+      const double x0_floor = floor(x0);
+      const double x1_ceil = ceil(x1);
+      const auto x0i = static_cast<std::size_t>(x0_floor) - i_begin;
+      const auto x1i = static_cast<std::size_t>(x1_ceil) - i_begin;
+      if (x1i <= x0i + 1) {
+
+        // The part of the edge lies in a single grid cell. The fraction of
+        // the cell to the right of the edge is one minus the distance of the
+        // edge's midpoint from the cell's left side.
+        const double x_mid = 0.5 * (x_first + x_last) - x0_floor;
+        row[x0i] += d - d * x_mid;
+        row[x0i + 1] += d * x_mid;
+      } else {
+
+        // The part of the edge spans several grid cells. The area to the
+        // right of the edge grows quadratically in the first and last cell
+        // and linearly in between.
+        const double s = 1.0 / (x1 - x0);
+        const double x0_frac = x0 - x0_floor;
+        const double a0 = 0.5 * s * (1.0 - x0_frac) * (1.0 - x0_frac);
+        const double x1_frac = x1 - x1_ceil + 1.0;
+        const double am = 0.5 * s * x1_frac * x1_frac;
+        row[x0i] += d * a0;
+        if (x1i == x0i + 2) {
+          row[x0i + 1] += d * (1.0 - a0 - am);
+        } else {
+          const double a1 = s * (1.5 - x0_frac);
+          row[x0i + 1] += d * (a1 - a0);
+          for (std::size_t i = x0i + 2; i + 1 < x1i; ++i) {
+            row[i] += d * s;
+          }
+          const double a2 = a1 + static_cast<double>(x1i - x0i - 3) * s;
+          row[x1i - 1] += d * (1.0 - a2 - am);
+        }
+        row[x1i] += d * am;
+      }
+    }
+  }
+
+  // Running sums along the rows
+  std::vector<cell_area> coverage;
+  for (std::size_t j = j_begin; j < j_end; ++j) {
+    const double *row = acc.data() + (j - j_begin) * row_length;
+    double cov = 0.0;
+    for (std::size_t i = i_begin; i < i_end; ++i) {
+      cov += row[i - i_begin];
+      if (cov > dbl_resolution) {
+        coverage.push_back({i * ly_ + j, cov});
+      }
+    }
+  }
+  return coverage;
+}
+
+void ExactCoverage::fill(
+  const std::vector<unsigned int> &regions,
+  boost::multi_array<double, 2> &rho_num,
+  boost::multi_array<double, 2> &rho_den,
+  const std::vector<double> &w_num,
+  const std::vector<double> &w_den)
+{
+  // The regions are rasterized independently of each other
+#pragma omp parallel for default(none) shared(regions) schedule(dynamic)
+  for (std::size_t k = 0; k < regions.size(); ++k) {
+    coverages_[regions[k]] = rasterize(edge_begin_[k], edge_begin_[k + 1]);
+  }
+
+  // Sum the weighted coverages in a fixed order
+  std::fill_n(rho_num.data(), rho_num.num_elements(), 0.0);
+  std::fill_n(rho_den.data(), rho_den.num_elements(), 0.0);
+  double *num = rho_num.data();
+  double *den = rho_den.data();
+  for (std::size_t r = 0; r < coverages_.size(); ++r) {
+    for (const auto &[cell, area] : coverages_[r]) {
+      num[cell] += w_num[r] * area;
+      den[cell] += w_den[r] * area;
+    }
+  }
+}
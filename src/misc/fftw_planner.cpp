@@ -0,0 +1,118 @@
+#include "fftw_planner.hpp"
+#include <fftw3.h>
+#include <iostream>
+#include <map>
+#include <tuple>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+
+// Flag passed to every fftw_plan_...() call. FFTW_ESTIMATE plans instantly,
+// whereas the other flags time candidate algorithms. The planning cost of
+// the latter can be paid once per grid shape by storing it in a wisdom file.
+unsigned int planner_flag = FFTW_ESTIMATE;
+std::string wisdom_file;
+
+const std::map<std::string, unsigned int> planner_flags = {
+  {"estimate", FFTW_ESTIMATE},
+  {"measure", FFTW_MEASURE},
+  {"patient", FFTW_PATIENT},
+  {"exhaustive", FFTW_EXHAUSTIVE}};
+
+// Key: lx, ly, kind0, kind1, whether the transform is in place
+typedef std::tuple<unsigned int, unsigned int, int, int, bool> plan_key;
+std::map<plan_key, fftw_plan> plan_cache;
+
+}  // namespace
+
+bool is_valid_fftw_planner(const std::string &planner)
+{
+  return planner_flags.contains(planner);
+}
+
+void set_up_fftw(
+  const std::string &planner,
+  const std::string &wisdom_file_name)
+{
+  planner_flag = planner_flags.at(planner);
+  wisdom_file = wisdom_file_name;
+
+#ifdef CARTOGRAM_FFTW_THREADS
+  // Let FFTW use as many threads as the OpenMP loops. The number of threads
+  // is part of the key under which FFTW stores wisdom.
+  if (fftw_init_threads() == 0) {
+    std::cerr << "WARNING: Could not initialize FFTW threads. "
+              << "Fourier transforms will be single-threaded." << std::endl;
+  } else {
+#ifdef _OPENMP
+    fftw_plan_with_nthreads(omp_get_max_threads());
+#endif
+  }
+#endif
+
+  // Wisdom is only useful if the planner measures. FFTW_ESTIMATE plans do
+  // not produce wisdom, but they would still use wisdom if available.
+  if (!wisdom_file.empty()) {
+    if (fftw_import_wisdom_from_filename(wisdom_file.c_str())) {
+      std::cerr << "Imported FFTW wisdom from " << wisdom_file << std::endl;
+    } else {
+      std::cerr << "No FFTW wisdom imported from " << wisdom_file
+                << ". Wisdom will be created." << std::endl;
+    }
+  }
+}
+
+unsigned int fftw_planner_flag()
+{
+  return planner_flag;
+}
+
+fftw_plan cached_fftw_plan(
+  const unsigned int lx,
+  const unsigned int ly,
+  double *in,
+  double *out,
+  const fftw_r2r_kind kind0,
+  const fftw_r2r_kind kind1)
+{
+  const plan_key key = {lx, ly, kind0, kind1, in == out};
+  const auto it = plan_cache.find(key);
+  if (it != plan_cache.end()) {
+    return it->second;
+  }
+
+  // Unless the planner flag is FFTW_ESTIMATE, planning overwrites the
+  // arrays. Hence, callers must request plans before filling the arrays.
+  const fftw_plan plan = fftw_plan_r2r_2d(
+    static_cast<int>(lx),  // fftw_plan_...() uses signed integers.
+    static_cast<int>(ly),
+    in,
+    out,
+    kind0,
+    kind1,
+    planner_flag);
+  plan_cache.emplace(key, plan);
+  return plan;
+}
+
+void clean_up_fftw()
+{
+  for (const auto &[key, plan] : plan_cache) {
+    fftw_destroy_plan(plan);
+  }
+  plan_cache.clear();
+  if (!wisdom_file.empty()) {
+    if (fftw_export_wisdom_to_filename(wisdom_file.c_str())) {
+      std::cerr << "Exported FFTW wisdom to " << wisdom_file << std::endl;
+    } else {
+      std::cerr << "WARNING: Could not export FFTW wisdom to " << wisdom_file
+                << std::endl;
+    }
+  }
+#ifdef CARTOGRAM_FFTW_THREADS
+  fftw_cleanup_threads();
+#endif
+}
@@ -1,4 +1,5 @@
 #include "ft_real_2d.hpp"
+#include "fftw_planner.hpp"
 #include <iostream>
 
 double *FTReal2d::as_1d_array() const
@@ -19,6 +20,10 @@ void FTReal2d::allocate(const unsigned int lx, const unsigned int ly)
               << std::endl;
     _Exit(98915);
   }
+
+  // Release the previous array, if any, so that reallocation after a change
+  // of the grid dimensions does not leak memory
+  free();
   lx_ = lx;
   ly_ = ly;
   array_ = static_cast<double *>(fftw_malloc(lx_ * ly_ * sizeof(double)));
@@ -27,24 +32,23 @@ void FTReal2d::allocate(const unsigned int lx, const unsigned int ly)
 void FTReal2d::free()
 {
   fftw_free(array_);
+  array_ = nullptr;
+  plan_ = nullptr;
 }
 
 void FTReal2d::make_fftw_plan(
   const fftw_r2r_kind &kind0,
   const fftw_r2r_kind &kind1)
 {
-  plan_ =
-    fftw_plan_r2r_2d(lx_, ly_, array_, array_, kind0, kind1, FFTW_ESTIMATE);
+  // Unless the planner flag is FFTW_ESTIMATE, planning overwrites array_.
+  // Hence, the plan must be made before the array is filled.
+  plan_ = cached_fftw_plan(lx_, ly_, array_, array_, kind0, kind1);
 }
 
 void FTReal2d::execute_fftw_plan()
 {
-  fftw_execute(plan_);
-}
-
-void FTReal2d::destroy_fftw_plan()
-{
-  fftw_destroy_plan(plan_);
+  // The cached plan may have been made for another array of the same shape
+  fftw_execute_r2r(plan_, array_, array_);
 }
 
 double &FTReal2d::operator()(const unsigned int i, const unsigned int j)
@@ -1,12 +1,5 @@
 #include "intersection.hpp"
 
-intersection::intersection() = default;
-
-intersection::intersection(bool side)
-    : is_x(side), ray_enters(false)  // Temporary value
-{
-}
-
 double intersection::x() const
 {
   return coord;
@@ -18,14 +11,14 @@ double intersection::y() const
 }
 
 // TODO: THE NAME ray_intersects() SOUNDS AS IF THE FUNCTION ONLY RETURNS A
-//       boolean ANSWER. HOWEVER, IT ALSO SETS coord AND target_density. IS IT
-//       POSSIBLE TO MOVE THE SIDE EFFECTS INTO SEPARATE FUNCTIONS?
+//       boolean ANSWER. HOWEVER, IT ALSO SETS coord. IS IT POSSIBLE TO MOVE
+//       THE SIDE EFFECT INTO A SEPARATE FUNCTION?
 bool intersection::ray_intersects(
   Point a,
   Point b,
   const double ray,
-  const double td,
-  const double epsilon)
+  const double epsilon,
+  const bool is_x)
 {
   // Flip coordinates if rays are in y-direction. The formulae below are the
   // same, except that x is replaced with y and vice versa.
@@ -48,7 +41,6 @@ bool intersection::ray_intersects(
     }
 
     // Edit intersection passed by reference. coord stores the x-coordinate.
-    target_density = td;
     coord = (a.x() * (b.y() - ray) + b.x() * (ray - a.y())) / (b.y() - a.y());
     return true;
   }
@@ -61,9 +53,8 @@ void add_intersections(
   std::vector<intersection> &intersections,
   const Polygon &pgn,
   const double ray,
-  const double target_density,
   const double epsilon,
-  const std::string &gd_id,
+  const unsigned int gd_index,
   const char axis)
 {
   if (axis != 'x' && axis != 'y') {
@@ -73,14 +64,14 @@ void add_intersections(
   Point prev_point = pgn[pgn.size() - 1];
   for (auto p : pgn) {
     const Point curr_point = p;
-    intersection temp(axis == 'x');
+    intersection temp;
     if (temp.ray_intersects(
           curr_point,
           prev_point,
           ray,
-          target_density,
-          epsilon)) {
-      temp.geo_div_id = gd_id;
+          epsilon,
+          axis == 'x')) {
+      temp.geo_div = gd_index;
       intersections.push_back(temp);
     }
     prev_point = curr_point;
@@ -0,0 +1,200 @@
+#include "linear_quadtree.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+// x- and y-index of a node among the 2^depth x 2^depth nodes of its depth
+static std::pair<std::uint32_t, std::uint32_t> node_index(std::uint64_t code)
+{
+  std::uint32_t ix = 0;
+  std::uint32_t iy = 0;
+  for (unsigned int b = LinearQuadtree::depth(code); b-- > 0;) {
+    ix = (ix << 1) | static_cast<std::uint32_t>((code >> (2 * b + 1)) & 1);
+    iy = (iy << 1) | static_cast<std::uint32_t>((code >> (2 * b)) & 1);
+  }
+  return {ix, iy};
+}
+
+// Inverse of node_index()
+static std::uint64_t node_code(
+  const unsigned int depth,
+  const std::uint32_t ix,
+  const std::uint32_t iy)
+{
+  std::uint64_t code = 1;
+  for (unsigned int b = depth; b-- > 0;) {
+    code = (code << 2) | (((ix >> b) & 1) << 1) | ((iy >> b) & 1);
+  }
+  return code;
+}
+
+unsigned int LinearQuadtree::depth(const std::uint64_t code)
+{
+  return (static_cast<unsigned int>(std::bit_width(code)) - 1) / 2;
+}
+
+void LinearQuadtree::reset(
+  const double x0,
+  const double y0,
+  const double side,
+  const unsigned int max_depth,
+  const unsigned int max_points)
+{
+  x0_ = x0;
+  y0_ = y0;
+  side_ = side;
+  max_depth_ = max_depth;
+  max_points_ = max_points;
+  leaves_ = {1};
+  point_codes_.clear();
+}
+
+void LinearQuadtree::free()
+{
+  leaves_ = {};
+  point_codes_ = {};
+}
+
+std::uint64_t LinearQuadtree::point_code(const double x, const double y)
+  const
+{
+  const double n = std::ldexp(1.0, static_cast<int>(max_depth_));
+  const auto index = [n](const double t) {
+    return static_cast<std::uint32_t>(
+      std::clamp(std::floor(t * n), 0.0, n - 1.0));
+  };
+  return node_code(
+    max_depth_,
+    index((x - x0_) / side_),
+    index((y - y0_) / side_));
+}
+
+// The descendants at depth max_depth_ of a node form a contiguous range of
+// codes. Hence, we can count the points in a node by binary search.
+std::size_t LinearQuadtree::n_points_in(const std::uint64_t code) const
+{
+  const unsigned int shift = 2 * (max_depth_ - depth(code));
+  const auto first = std::lower_bound(
+    point_codes_.begin(),
+    point_codes_.end(),
+    code << shift);
+  const auto last =
+    std::lower_bound(first, point_codes_.end(), (code + 1) << shift);
+  return static_cast<std::size_t>(last - first);
+}
+
+std::size_t LinearQuadtree::update(std::vector<std::uint64_t> codes)
+{
+  std::sort(codes.begin(), codes.end());
+  point_codes_ = std::move(codes);
+  std::size_t n_changes = 0;
+
+  // Split leaves that contain too many points. The children are checked in
+  // turn.
+  std::vector<std::uint64_t> stack(leaves_.begin(), leaves_.end());
+  while (!stack.empty()) {
+    const std::uint64_t code = stack.back();
+    stack.pop_back();
+    if (depth(code) < max_depth_ && n_points_in(code) > max_points_) {
+      leaves_.erase(code);
+      for (std::uint64_t c = 0; c < 4; ++c) {
+        leaves_.insert(4 * code + c);
+        stack.push_back(4 * code + c);
+      }
+      ++n_changes;
+    }
+  }
+
+  // Merge four sibling leaves if their parent does not contain too many
+  // points. The merged leaf may, in turn, be merged with its siblings. The
+  // number of points in a node is at least the number in any descendant.
+  // Thus, the resulting set of leaves does not depend on the order in which
+  // the leaves are visited.
+  const std::vector<std::uint64_t> candidates(leaves_.begin(), leaves_.end());
+  for (std::uint64_t code : candidates) {
+    while (code > 1 && leaves_.contains(code)) {
+      const std::uint64_t parent = code >> 2;
+      bool children_are_leaves = true;
+      for (std::uint64_t c = 0; c < 4; ++c) {
+        children_are_leaves =
+          children_are_leaves && leaves_.contains(4 * parent + c);
+      }
+      if (!children_are_leaves || n_points_in(parent) > max_points_) {
+        break;
+      }
+      for (std::uint64_t c = 0; c < 4; ++c) {
+        leaves_.erase(4 * parent + c);
+      }
+      leaves_.insert(parent);
+      ++n_changes;
+      code = parent;
+    }
+  }
+  return n_changes;
+}
+
+std::vector<std::uint64_t> LinearQuadtree::graded_leaves() const
+{
+  std::unordered_set<std::uint64_t> graded(leaves_);
+  std::vector<std::uint64_t> stack(leaves_.begin(), leaves_.end());
+  std::sort(stack.begin(), stack.end());
+  while (!stack.empty()) {
+    const std::uint64_t code = stack.back();
+    stack.pop_back();
+    const unsigned int d = depth(code);
+    if (!graded.contains(code) || d < 2) {
+      continue;
+    }
+
+    // Look for a leaf that shares an edge with the node and whose depth is
+    // less than d-1. Such a leaf must be an ancestor of one of the four
+    // neighbours of the same depth as the node.
+    const auto [ix, iy] = node_index(code);
+    const std::uint32_t n = std::uint32_t{1} << d;
+    const std::array<std::pair<std::int64_t, std::int64_t>, 4> neighbours{
+      {{std::int64_t{ix} - 1, iy},
+       {std::int64_t{ix} + 1, iy},
+       {ix, std::int64_t{iy} - 1},
+       {ix, std::int64_t{iy} + 1}}};
+    for (const auto &[nx, ny] : neighbours) {
+      if (nx < 0 || ny < 0 || nx >= n || ny >= n) {
+        continue;
+      }
+      const std::uint64_t neighbour = node_code(
+        d,
+        static_cast<std::uint32_t>(nx),
+        static_cast<std::uint32_t>(ny));
+      std::uint64_t ancestor = neighbour >> 4;  // Depth d-2
+      while (ancestor > 0 && !graded.contains(ancestor)) {
+        ancestor >>= 2;
+      }
+      if (ancestor > 0) {
+
+        // Split the shallow leaf and check both its children and the node
+        // again
+        graded.erase(ancestor);
+        stack.push_back(code);
+        for (std::uint64_t c = 0; c < 4; ++c) {
+          graded.insert(4 * ancestor + c);
+          stack.push_back(4 * ancestor + c);
+        }
+        break;
+      }
+    }
+  }
+  std::vector<std::uint64_t> result(graded.begin(), graded.end());
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::array<double, 4> LinearQuadtree::bbox(const std::uint64_t code) const
+{
+  const auto [ix, iy] = node_index(code);
+  const double size = std::ldexp(side_, -static_cast<int>(depth(code)));
+  return {
+    x0_ + ix * size,
+    y0_ + iy * size,
+    x0_ + (ix + 1) * size,
+    y0_ + (iy + 1) * size};
+}
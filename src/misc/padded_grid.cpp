@@ -0,0 +1,247 @@
+#include "padded_grid.hpp"
+#include <iostream>
+
+// The vectorized kernels are compiled with function-specific target
+// attributes and selected at run time. Thus, the same binary runs on CPUs
+// with and without AVX2/AVX-512.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CARTOGRAM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+SimdLevel best_simd_level()
+{
+#ifdef CARTOGRAM_X86_SIMD
+  static const SimdLevel level = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return SimdLevel::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdLevel::avx2;
+    }
+    return SimdLevel::scalar;
+  }();
+  return level;
+#else
+  return SimdLevel::scalar;
+#endif
+}
+
+void PaddedGrid::allocate(
+  const unsigned int lx,
+  const unsigned int ly,
+  const char zero)
+{
+  if (lx * ly <= 0) {
+    std::cerr << "Invalid array dimensions in PaddedGrid::allocate()"
+              << std::endl;
+    _Exit(98916);
+  }
+  if (zero != 'x' && zero != 'y' && zero != 'n') {
+    std::cerr << "ERROR: unknown argument zero in " << __func__ << "()."
+              << std::endl;
+    exit(1);
+  }
+  lx_ = lx;
+  ly_ = ly;
+  zero_ = zero;
+  data_.assign(static_cast<std::size_t>(lx + 2) * (ly + 2), 0.0);
+}
+
+void PaddedGrid::fill_ghost_cells()
+{
+  const std::size_t stride = ly_ + 2;
+  if (zero_ == 'x') {
+
+    // The function vanishes on the edges x = 0 and x = lx ...
+    for (unsigned int j = 0; j < ly_ + 2; ++j) {
+      data_[j] = 0.0;
+      data_[(lx_ + 1) * stride + j] = 0.0;
+    }
+
+    // ... and has zero slope on the edges y = 0 and y = ly
+    for (unsigned int i = 1; i <= lx_; ++i) {
+      data_[i * stride] = data_[i * stride + 1];
+      data_[i * stride + ly_ + 1] = data_[i * stride + ly_];
+    }
+  } else if (zero_ == 'y') {
+
+    // The function vanishes on the edges y = 0 and y = ly ...
+    for (unsigned int i = 0; i < lx_ + 2; ++i) {
+      data_[i * stride] = 0.0;
+      data_[i * stride + ly_ + 1] = 0.0;
+    }
+
+    // ... and has zero slope on the edges x = 0 and x = lx
+    for (unsigned int j = 1; j <= ly_; ++j) {
+      data_[j] = data_[stride + j];
+      data_[(lx_ + 1) * stride + j] = data_[lx_ * stride + j];
+    }
+  } else {
+
+    // Zero slope on all edges. The corners are copied from the rows that
+    // were already continued.
+    for (unsigned int i = 1; i <= lx_; ++i) {
+      data_[i * stride] = data_[i * stride + 1];
+      data_[i * stride + ly_ + 1] = data_[i * stride + ly_];
+    }
+    for (unsigned int j = 0; j < ly_ + 2; ++j) {
+      data_[j] = data_[stride + j];
+      data_[(lx_ + 1) * stride + j] = data_[lx_ * stride + j];
+    }
+  }
+}
+
+#ifdef CARTOGRAM_X86_SIMD
+
+// GCC's intrinsics initialize their unused pass-through operands with
+// _mm256_undefined_pd() etc., which triggers false -Wmaybe-uninitialized
+// warnings
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// The vectorized kernels perform exactly the same floating-point operations
+// in the same order as the scalar function. Note that multiplications and
+// additions must not be contracted to fused multiply-adds. The compiler does
+// not contract them because we compile with -ffp-contract=off.
+__attribute__((target("avx2"))) static std::size_t interpolate_avx2(
+  const double *data,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  double *out)
+{
+  const int stride = static_cast<int>(ly) + 2;
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d dlx = _mm256_set1_pd(lx);
+  const __m256d dly = _mm256_set1_pd(ly);
+  const __m256d dstride = _mm256_set1_pd(stride);
+  std::size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const __m256d vx = _mm256_loadu_pd(x + k);
+    const __m256d vy = _mm256_loadu_pd(y + k);
+    const __m256d kx = _mm256_floor_pd(_mm256_add_pd(vx, half));
+    const __m256d ky = _mm256_floor_pd(_mm256_add_pd(vy, half));
+
+    // _mm256_max_pd(a, b) returns (a > b) ? a : b, which equals
+    // std::max(b, a). Similarly for _mm256_min_pd().
+    const __m256d x0 = _mm256_max_pd(_mm256_sub_pd(kx, half), zero);
+    const __m256d x1 = _mm256_min_pd(_mm256_add_pd(kx, half), dlx);
+    const __m256d y0 = _mm256_max_pd(_mm256_sub_pd(ky, half), zero);
+    const __m256d y1 = _mm256_min_pd(_mm256_add_pd(ky, half), dly);
+    const __m256d dx =
+      _mm256_div_pd(_mm256_sub_pd(vx, x0), _mm256_sub_pd(x1, x0));
+    const __m256d dy =
+      _mm256_div_pd(_mm256_sub_pd(vy, y0), _mm256_sub_pd(y1, y0));
+
+    // Offsets of the lower-left corners. They are integers smaller than
+    // 2^31, so the products are exact.
+    const __m128i idx =
+      _mm256_cvtpd_epi32(_mm256_add_pd(_mm256_mul_pd(kx, dstride), ky));
+    const __m256d f00 = _mm256_i32gather_pd(data, idx, 8);
+    const __m256d f01 = _mm256_i32gather_pd(data + 1, idx, 8);
+    const __m256d f10 = _mm256_i32gather_pd(data + stride, idx, 8);
+    const __m256d f11 = _mm256_i32gather_pd(data + stride + 1, idx, 8);
+    const __m256d one_minus_dx = _mm256_sub_pd(one, dx);
+    const __m256d one_minus_dy = _mm256_sub_pd(one, dy);
+    __m256d res =
+      _mm256_mul_pd(_mm256_mul_pd(one_minus_dx, one_minus_dy), f00);
+    res = _mm256_add_pd(
+      res,
+      _mm256_mul_pd(_mm256_mul_pd(one_minus_dx, dy), f01));
+    res = _mm256_add_pd(
+      res,
+      _mm256_mul_pd(_mm256_mul_pd(dx, one_minus_dy), f10));
+    res = _mm256_add_pd(res, _mm256_mul_pd(_mm256_mul_pd(dx, dy), f11));
+    _mm256_storeu_pd(out + k, res);
+  }
+  return k;
+}
+
+__attribute__((target("avx512f"))) static std::size_t interpolate_avx512(
+  const double *data,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  double *out)
+{
+  const int stride = static_cast<int>(ly) + 2;
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d dlx = _mm512_set1_pd(lx);
+  const __m512d dly = _mm512_set1_pd(ly);
+  const __m512d dstride = _mm512_set1_pd(stride);
+  constexpr int round_down = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+  std::size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    const __m512d vx = _mm512_loadu_pd(x + k);
+    const __m512d vy = _mm512_loadu_pd(y + k);
+    const __m512d kx =
+      _mm512_roundscale_pd(_mm512_add_pd(vx, half), round_down);
+    const __m512d ky =
+      _mm512_roundscale_pd(_mm512_add_pd(vy, half), round_down);
+    const __m512d x0 = _mm512_max_pd(_mm512_sub_pd(kx, half), zero);
+    const __m512d x1 = _mm512_min_pd(_mm512_add_pd(kx, half), dlx);
+    const __m512d y0 = _mm512_max_pd(_mm512_sub_pd(ky, half), zero);
+    const __m512d y1 = _mm512_min_pd(_mm512_add_pd(ky, half), dly);
+    const __m512d dx =
+      _mm512_div_pd(_mm512_sub_pd(vx, x0), _mm512_sub_pd(x1, x0));
+    const __m512d dy =
+      _mm512_div_pd(_mm512_sub_pd(vy, y0), _mm512_sub_pd(y1, y0));
+    const __m256i idx =
+      _mm512_cvtpd_epi32(_mm512_add_pd(_mm512_mul_pd(kx, dstride), ky));
+    const __m512d f00 = _mm512_i32gather_pd(idx, data, 8);
+    const __m512d f01 = _mm512_i32gather_pd(idx, data + 1, 8);
+    const __m512d f10 = _mm512_i32gather_pd(idx, data + stride, 8);
+    const __m512d f11 = _mm512_i32gather_pd(idx, data + stride + 1, 8);
+    const __m512d one_minus_dx = _mm512_sub_pd(one, dx);
+    const __m512d one_minus_dy = _mm512_sub_pd(one, dy);
+    __m512d res =
+      _mm512_mul_pd(_mm512_mul_pd(one_minus_dx, one_minus_dy), f00);
+    res = _mm512_add_pd(
+      res,
+      _mm512_mul_pd(_mm512_mul_pd(one_minus_dx, dy), f01));
+    res = _mm512_add_pd(
+      res,
+      _mm512_mul_pd(_mm512_mul_pd(dx, one_minus_dy), f10));
+    res = _mm512_add_pd(res, _mm512_mul_pd(_mm512_mul_pd(dx, dy), f11));
+    _mm512_storeu_pd(out + k, res);
+  }
+  return k;
+}
+
+#pragma GCC diagnostic pop
+
+#endif  // CARTOGRAM_X86_SIMD
+
+void PaddedGrid::interpolate_bilinearly(
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  double *out,
+  const SimdLevel simd_level) const
+{
+  // Number of points handled by the vectorized kernel. The remaining points
+  // are interpolated one by one.
+  std::size_t n_done = 0;
+#ifdef CARTOGRAM_X86_SIMD
+  if (simd_level == SimdLevel::avx512) {
+    n_done = interpolate_avx512(data_.data(), lx_, ly_, x, y, n, out);
+  } else if (simd_level == SimdLevel::avx2) {
+    n_done = interpolate_avx2(data_.data(), lx_, ly_, x, y, n, out);
+  }
+#else
+  (void)simd_level;
+#endif
+  for (std::size_t k = n_done; k < n; ++k) {
+    out[k] = interpolate_bilinearly(x[k], y[k]);
+  }
+}
@@ -1,5 +1,6 @@
 #include "parse_arguments.hpp"
 #include "constants.hpp"
+#include "fftw_planner.hpp"
 
 argparse::ArgumentParser parsed_arguments(
   const int argc,
@@ -8,6 +9,11 @@ argparse::ArgumentParser parsed_arguments(
   std::string &visual_file_name,
   unsigned int &max_n_grid_rows_or_cols,
   unsigned int &target_points_per_inset,
+  unsigned int &n_threads,
+  std::string &fftw_planner,
+  std::string &fftw_wisdom_file,
+  Integrator &integrator,
+  bool &exact_coverage,
   bool &world,
   bool &triangulation,
   bool &qtdt_method,
@@ -92,6 +98,32 @@ argparse::ArgumentParser parsed_arguments(
       "Integer: If simplification enabled, target number of points per inset")
     .default_value(default_target_points_per_inset)
     .scan<'u', unsigned int>();
+  arguments.add_argument("--threads")
+    .help(
+      std::string("Integer: Number of OpenMP threads ") +
+      "[default: 0, i.e., use all available cores]")
+    .default_value(0u)
+    .scan<'u', unsigned int>();
+  arguments.add_argument("--fftw_planner")
+    .help(
+      std::string("String: FFTW planner rigor (estimate, measure, patient, ") +
+      "or exhaustive)")
+    .default_value(std::string("estimate"));
+  arguments.add_argument("--fftw_wisdom")
+    .help(
+      std::string("File path: FFTW wisdom file, loaded at startup and ") +
+      "saved on exit");
+  arguments.add_argument("--integrator")
+    .help(
+      std::string("String: Integrator for the flow-based method (midpoint ") +
+      "or rk23) [default: midpoint]")
+    .default_value(std::string("midpoint"));
+  arguments.add_argument("--exact_coverage")
+    .help(
+      std::string("Boolean: Rasterize the density from the exact area of ") +
+      "each grid cell covered by each region instead of sampling with rays")
+    .default_value(false)
+    .implicit_value(true);
   arguments.add_argument("-M", "--make_csv")
     .help("Boolean: create CSV file from given GeoJSON?")
     .default_value(false)
@@ -142,6 +174,34 @@ argparse::ArgumentParser parsed_arguments(
   // Set target_points_per_inset
   target_points_per_inset = arguments.get<unsigned int>("-P");
 
+  // Set number of OpenMP threads. Zero leaves the choice to the OpenMP
+  // runtime (i.e., OMP_NUM_THREADS or the number of available cores).
+  n_threads = arguments.get<unsigned int>("--threads");
+
+  // Set FFTW planner and wisdom file
+  fftw_planner = arguments.get<std::string>("--fftw_planner");
+  if (!is_valid_fftw_planner(fftw_planner)) {
+    std::cerr << "ERROR: Invalid FFTW planner " << fftw_planner << "!\n";
+    std::cerr << "Use estimate, measure, patient, or exhaustive.\n";
+    std::cerr << arguments << std::endl;
+    _Exit(22);
+  }
+  if (arguments.is_used("--fftw_wisdom")) {
+    fftw_wisdom_file = arguments.get<std::string>("--fftw_wisdom");
+  }
+
+  // Set integrator for the flow-based method
+  const std::string integrator_name =
+    arguments.get<std::string>("--integrator");
+  if (!integrator_names.contains(integrator_name)) {
+    std::cerr << "ERROR: Invalid integrator " << integrator_name << "!\n";
+    std::cerr << "Use midpoint or rk23.\n";
+    std::cerr << arguments << std::endl;
+    _Exit(22);
+  }
+  integrator = integrator_names.at(integrator_name);
+  exact_coverage = arguments.get<bool>("--exact_coverage");
+
   // Set boolean values
   world = arguments.get<bool>("-W");
   triangulation = arguments.get<bool>("-T");
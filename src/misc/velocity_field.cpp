@@ -0,0 +1,252 @@
+#include "velocity_field.hpp"
+
+// See padded_grid.cpp for the run-time dispatch of the vectorized kernels
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CARTOGRAM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+void VelocityField::allocate(const unsigned int lx, const unsigned int ly)
+{
+  flux_x_.allocate(lx, ly, 'x');
+  flux_y_.allocate(lx, ly, 'y');
+  rho_diff_.allocate(lx, ly, 'n');
+  lx_ = lx;
+  ly_ = ly;
+}
+
+void VelocityField::free()
+{
+  flux_x_.free();
+  flux_y_.free();
+  rho_diff_.free();
+}
+
+void VelocityField::fill_ghost_cells()
+{
+  // The velocity in a ghost cell is either zero (because the flux is zero)
+  // or equal to the velocity in the adjacent grid cell (because the flux and
+  // the density are copied from there)
+  flux_x_.fill_ghost_cells();
+  flux_y_.fill_ghost_cells();
+  rho_diff_.fill_ghost_cells();
+}
+
+#ifdef CARTOGRAM_X86_SIMD
+
+// GCC's intrinsics initialize their unused pass-through operands with
+// _mm256_undefined_pd() etc., which triggers false -Wmaybe-uninitialized
+// warnings
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// The vectorized kernels perform exactly the same floating-point operations
+// in the same order as the scalar function
+__attribute__((target("avx2"))) static std::size_t velocity_avx2(
+  const double *flux_x,
+  const double *flux_y,
+  const double *rho_diff,
+  const double rho_mean,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  const double t,
+  double *vx,
+  double *vy)
+{
+  const int stride = static_cast<int>(ly) + 2;
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d dlx = _mm256_set1_pd(lx);
+  const __m256d dly = _mm256_set1_pd(ly);
+  const __m256d dstride = _mm256_set1_pd(stride);
+  const __m256d vrho_mean = _mm256_set1_pd(rho_mean);
+  const __m256d one_minus_t = _mm256_set1_pd(1.0 - t);
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  const int corner[4] = {0, 1, stride, stride + 1};
+  std::size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const __m256d px = _mm256_loadu_pd(x + k);
+    const __m256d py = _mm256_loadu_pd(y + k);
+    const __m256d kx = _mm256_floor_pd(_mm256_add_pd(px, half));
+    const __m256d ky = _mm256_floor_pd(_mm256_add_pd(py, half));
+    const __m256d x0 = _mm256_max_pd(_mm256_sub_pd(kx, half), zero);
+    const __m256d x1 = _mm256_min_pd(_mm256_add_pd(kx, half), dlx);
+    const __m256d y0 = _mm256_max_pd(_mm256_sub_pd(ky, half), zero);
+    const __m256d y1 = _mm256_min_pd(_mm256_add_pd(ky, half), dly);
+    const __m256d dx =
+      _mm256_div_pd(_mm256_sub_pd(px, x0), _mm256_sub_pd(x1, x0));
+    const __m256d dy =
+      _mm256_div_pd(_mm256_sub_pd(py, y0), _mm256_sub_pd(y1, y0));
+    const __m128i idx =
+      _mm256_cvtpd_epi32(_mm256_add_pd(_mm256_mul_pd(kx, dstride), ky));
+    const __m256d one_minus_dx = _mm256_sub_pd(one, dx);
+    const __m256d one_minus_dy = _mm256_sub_pd(one, dy);
+    const __m256d weight[4] = {
+      _mm256_mul_pd(one_minus_dx, one_minus_dy),
+      _mm256_mul_pd(one_minus_dx, dy),
+      _mm256_mul_pd(dx, one_minus_dy),
+      _mm256_mul_pd(dx, dy)};
+    __m256d res_x = zero, res_y = zero;
+    for (unsigned int c = 0; c < 4; ++c) {
+      const __m256d d = _mm256_i32gather_pd(rho_diff + corner[c], idx, 8);
+      const __m256d fx = _mm256_i32gather_pd(flux_x + corner[c], idx, 8);
+      const __m256d fy = _mm256_i32gather_pd(flux_y + corner[c], idx, 8);
+      const __m256d rho =
+        _mm256_add_pd(vrho_mean, _mm256_mul_pd(one_minus_t, d));
+      const __m256d fvx = _mm256_div_pd(_mm256_xor_pd(fx, sign), rho);
+      const __m256d fvy = _mm256_div_pd(_mm256_xor_pd(fy, sign), rho);
+
+      // The first term is not added to zero because 0.0 + (-0.0) would
+      // differ in sign from the scalar function
+      if (c == 0) {
+        res_x = _mm256_mul_pd(weight[c], fvx);
+        res_y = _mm256_mul_pd(weight[c], fvy);
+      } else {
+        res_x = _mm256_add_pd(res_x, _mm256_mul_pd(weight[c], fvx));
+        res_y = _mm256_add_pd(res_y, _mm256_mul_pd(weight[c], fvy));
+      }
+    }
+    _mm256_storeu_pd(vx + k, res_x);
+    _mm256_storeu_pd(vy + k, res_y);
+  }
+  return k;
+}
+
+__attribute__((target("avx512f"))) static std::size_t velocity_avx512(
+  const double *flux_x,
+  const double *flux_y,
+  const double *rho_diff,
+  const double rho_mean,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  const double t,
+  double *vx,
+  double *vy)
+{
+  const int stride = static_cast<int>(ly) + 2;
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d dlx = _mm512_set1_pd(lx);
+  const __m512d dly = _mm512_set1_pd(ly);
+  const __m512d dstride = _mm512_set1_pd(stride);
+  const __m512d vrho_mean = _mm512_set1_pd(rho_mean);
+  const __m512d one_minus_t = _mm512_set1_pd(1.0 - t);
+  const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+  constexpr int round_down = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+  const int corner[4] = {0, 1, stride, stride + 1};
+  std::size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    const __m512d px = _mm512_loadu_pd(x + k);
+    const __m512d py = _mm512_loadu_pd(y + k);
+    const __m512d kx =
+      _mm512_roundscale_pd(_mm512_add_pd(px, half), round_down);
+    const __m512d ky =
+      _mm512_roundscale_pd(_mm512_add_pd(py, half), round_down);
+    const __m512d x0 = _mm512_max_pd(_mm512_sub_pd(kx, half), zero);
+    const __m512d x1 = _mm512_min_pd(_mm512_add_pd(kx, half), dlx);
+    const __m512d y0 = _mm512_max_pd(_mm512_sub_pd(ky, half), zero);
+    const __m512d y1 = _mm512_min_pd(_mm512_add_pd(ky, half), dly);
+    const __m512d dx =
+      _mm512_div_pd(_mm512_sub_pd(px, x0), _mm512_sub_pd(x1, x0));
+    const __m512d dy =
+      _mm512_div_pd(_mm512_sub_pd(py, y0), _mm512_sub_pd(y1, y0));
+    const __m256i idx =
+      _mm512_cvtpd_epi32(_mm512_add_pd(_mm512_mul_pd(kx, dstride), ky));
+    const __m512d one_minus_dx = _mm512_sub_pd(one, dx);
+    const __m512d one_minus_dy = _mm512_sub_pd(one, dy);
+    const __m512d weight[4] = {
+      _mm512_mul_pd(one_minus_dx, one_minus_dy),
+      _mm512_mul_pd(one_minus_dx, dy),
+      _mm512_mul_pd(dx, one_minus_dy),
+      _mm512_mul_pd(dx, dy)};
+    __m512d res_x = zero, res_y = zero;
+    for (unsigned int c = 0; c < 4; ++c) {
+      const __m512d d = _mm512_i32gather_pd(idx, rho_diff + corner[c], 8);
+      const __m512d fx = _mm512_i32gather_pd(idx, flux_x + corner[c], 8);
+      const __m512d fy = _mm512_i32gather_pd(idx, flux_y + corner[c], 8);
+      const __m512d rho =
+        _mm512_add_pd(vrho_mean, _mm512_mul_pd(one_minus_t, d));
+
+      // AVX-512F has no floating-point XOR, so the sign is flipped with an
+      // integer XOR
+      const __m512d neg_fx = _mm512_castsi512_pd(
+        _mm512_xor_si512(_mm512_castpd_si512(fx), sign));
+      const __m512d neg_fy = _mm512_castsi512_pd(
+        _mm512_xor_si512(_mm512_castpd_si512(fy), sign));
+      const __m512d fvx = _mm512_div_pd(neg_fx, rho);
+      const __m512d fvy = _mm512_div_pd(neg_fy, rho);
+      if (c == 0) {
+        res_x = _mm512_mul_pd(weight[c], fvx);
+        res_y = _mm512_mul_pd(weight[c], fvy);
+      } else {
+        res_x = _mm512_add_pd(res_x, _mm512_mul_pd(weight[c], fvx));
+        res_y = _mm512_add_pd(res_y, _mm512_mul_pd(weight[c], fvy));
+      }
+    }
+    _mm512_storeu_pd(vx + k, res_x);
+    _mm512_storeu_pd(vy + k, res_y);
+  }
+  return k;
+}
+
+#pragma GCC diagnostic pop
+
+#endif  // CARTOGRAM_X86_SIMD
+
+void VelocityField::velocity(
+  const double *x,
+  const double *y,
+  const std::size_t n,
+  const double t,
+  double *vx,
+  double *vy,
+  const SimdLevel simd_level) const
+{
+  // Number of points handled by the vectorized kernel. The remaining points
+  // are evaluated one by one.
+  std::size_t n_done = 0;
+#ifdef CARTOGRAM_X86_SIMD
+  if (simd_level == SimdLevel::avx512) {
+    n_done = velocity_avx512(
+      flux_x_.data(),
+      flux_y_.data(),
+      rho_diff_.data(),
+      rho_mean_,
+      lx_,
+      ly_,
+      x,
+      y,
+      n,
+      t,
+      vx,
+      vy);
+  } else if (simd_level == SimdLevel::avx2) {
+    n_done = velocity_avx2(
+      flux_x_.data(),
+      flux_y_.data(),
+      rho_diff_.data(),
+      rho_mean_,
+      lx_,
+      ly_,
+      x,
+      y,
+      n,
+      t,
+      vx,
+      vy);
+  }
+#else
+  (void)simd_level;
+#endif
+  for (std::size_t k = n_done; k < n; ++k) {
+    velocity(x[k], y[k], t, vx[k], vy[k]);
+  }
+}
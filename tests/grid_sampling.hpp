@@ -0,0 +1,54 @@
+#ifndef GRID_SAMPLING_HPP_
+#define GRID_SAMPLING_HPP_
+
+#include "padded_grid.hpp"
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Sample points in [0, lx] x [0, ly] for tests that compare interpolations
+// on an lx x ly grid. Besides random points, they include the edges, the
+// corners and half-integer coordinates, where the interpolation switches
+// between grid cells.
+inline void sample_points(
+  const unsigned int lx,
+  const unsigned int ly,
+  std::vector<double> &x,
+  std::vector<double> &y)
+{
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  for (unsigned int k = 0; k < 10000; ++k) {
+    double px = dist(gen) * lx;
+    double py = dist(gen) * ly;
+    if (k % 3 == 0) {
+      px = std::floor(2 * px) / 2;
+    }
+    if (k % 5 == 0) {
+      py = std::floor(2 * py) / 2;
+    }
+    x.push_back(px);
+    y.push_back(py);
+  }
+  for (const double px : {0.0, 0.25, 0.5, lx - 0.5, lx - 0.25, lx + 0.0}) {
+    for (const double py : {0.0, 0.25, 0.5, ly - 0.5, ly - 0.25, ly + 0.0}) {
+      x.push_back(px);
+      y.push_back(py);
+    }
+  }
+}
+
+// SIMD levels that the CPU running the test supports
+inline std::vector<SimdLevel> supported_simd_levels()
+{
+  std::vector<SimdLevel> levels = {SimdLevel::scalar};
+  if (best_simd_level() != SimdLevel::scalar) {
+    levels.push_back(SimdLevel::avx2);
+  }
+  if (best_simd_level() == SimdLevel::avx512) {
+    levels.push_back(SimdLevel::avx512);
+  }
+  return levels;
+}
+
+#endif // GRID_SAMPLING_HPP_
@@ -0,0 +1,346 @@
+#define BOOST_TEST_MODULE ExactCoverageTest
+#include "exact_coverage.hpp"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+struct point {
+  double x_, y_;
+  double x() const
+  {
+    return x_;
+  }
+  double y() const
+  {
+    return y_;
+  }
+};
+using ring = std::vector<point>;
+
+const unsigned int lx = 6, ly = 5;
+const double tolerance = 1e-12;
+
+ring reversed(ring r)
+{
+  std::reverse(r.begin(), r.end());
+  return r;
+}
+
+// Area of a ring, clipped to the grid cell [i, i+1] x [j, j+1] with the
+// Sutherland-Hodgman algorithm. It does not depend on the orientation.
+double clipped_area(ring r, const unsigned int i, const unsigned int j)
+{
+  // Keep the part of the ring where sign * (coordinate - bound) >= 0
+  const auto clip = [&r](
+                      const bool is_x,
+                      const double bound,
+                      const double sign) {
+    const auto dist = [&](const point &p) {
+      return sign * ((is_x ? p.x() : p.y()) - bound);
+    };
+    ring clipped;
+    for (std::size_t k = 0; k < r.size(); ++k) {
+      const point &a = r[k];
+      const point &b = r[(k + 1) % r.size()];
+      const double da = dist(a);
+      const double db = dist(b);
+      if (da >= 0) {
+        clipped.push_back(a);
+      }
+      if ((da >= 0) != (db >= 0)) {
+        const double t = da / (da - db);
+        clipped.push_back(
+          {a.x() + t * (b.x() - a.x()), a.y() + t * (b.y() - a.y())});
+      }
+    }
+    r = clipped;
+  };
+  clip(true, i, 1.0);
+  clip(true, i + 1.0, -1.0);
+  clip(false, j, 1.0);
+  clip(false, j + 1.0, -1.0);
+  double area2 = 0.0;
+  for (std::size_t k = 0; k < r.size(); ++k) {
+    const point &a = r[k];
+    const point &b = r[(k + 1) % r.size()];
+    area2 += a.x() * b.y() - b.x() * a.y();
+  }
+  return 0.5 * std::abs(area2);
+}
+
+struct density {
+  boost::multi_array<double, 2> num{boost::extents[lx][ly]};
+  boost::multi_array<double, 2> den{boost::extents[lx][ly]};
+};
+
+// Region with a single exterior ring
+struct region {
+  ring r;
+  double w_num, w_den;
+};
+
+// Refill rho with the given regions. Shifts below the tolerance are kept in
+// vertex_shifts.
+void refill(
+  ExactCoverage &coverage,
+  density &rho,
+  const std::vector<region> &regions,
+  std::vector<double> &vertex_shifts)
+{
+  std::vector<double> w_num, w_den;
+  for (const auto &reg : regions) {
+    w_num.push_back(reg.w_num);
+    w_den.push_back(reg.w_den);
+  }
+  coverage.refill(
+    rho.num,
+    rho.den,
+    w_num,
+    w_den,
+    vertex_shifts,
+    [&](const unsigned int r) {
+      coverage.add_ring(regions[r].r, false);
+    });
+}
+
+// rho_num and rho_den after rasterizing a region with the given rings
+density rasterize(
+  const std::vector<std::pair<ring, bool>> &rings,
+  const double w_num,
+  const double w_den)
+{
+  ExactCoverage coverage;
+  coverage.reset(lx, ly);
+  density rho;
+  std::vector<double> vertex_shifts;
+  coverage.refill(
+    rho.num,
+    rho.den,
+    {w_num},
+    {w_den},
+    vertex_shifts,
+    [&](unsigned int) {
+      for (const auto &[r, is_hole] : rings) {
+        coverage.add_ring(r, is_hole);
+      }
+    });
+  return rho;
+}
+
+// Check that rho_num and rho_den are w_num and w_den times the expected
+// covered areas
+void check_areas(
+  const density &rho,
+  const boost::multi_array<double, 2> &area,
+  const double w_num,
+  const double w_den)
+{
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      BOOST_TEST_CONTEXT("grid cell " << i << ", " << j)
+      {
+        BOOST_CHECK_SMALL(rho.num[i][j] - w_num * area[i][j], tolerance);
+        BOOST_CHECK_SMALL(rho.den[i][j] - w_den * area[i][j], tolerance);
+      }
+    }
+  }
+}
+
+// Compare the rasterized ring with the clipped areas for both orientations
+void check_ring(const ring &r)
+{
+  boost::multi_array<double, 2> area(boost::extents[lx][ly]);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      area[i][j] = clipped_area(r, i, j);
+    }
+  }
+  check_areas(rasterize({{r, false}}, 3.0, 2.0), area, 3.0, 2.0);
+  check_areas(rasterize({{reversed(r), false}}, 3.0, 2.0), area, 3.0, 2.0);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestUnitSquare)
+{
+  // Aligned with the grid cells
+  const ring aligned{{1.0, 2.0}, {2.0, 2.0}, {2.0, 3.0}, {1.0, 3.0}};
+  const density rho = rasterize({{aligned, false}}, 3.0, 2.0);
+  BOOST_CHECK_CLOSE(rho.num[1][2], 3.0, 1e-10);
+  BOOST_CHECK_CLOSE(rho.den[1][2], 2.0, 1e-10);
+  check_ring(aligned);
+
+  // Straddling four grid cells
+  check_ring({{0.5, 0.25}, {1.5, 0.25}, {1.5, 1.25}, {0.5, 1.25}});
+
+  // On the right boundary x = lx, where edges deposit into the element
+  // lx+1 of the accumulation arrays
+  check_ring({{lx - 1.0, 0.0}, {lx, 0.0}, {lx, ly}, {lx - 1.0, ly}});
+
+  // Covering the whole lattice
+  check_ring({{0.0, 0.0}, {lx, 0.0}, {lx, ly}, {0.0, ly}});
+}
+
+BOOST_AUTO_TEST_CASE(TestTriangles)
+{
+  // Crossing several grid cells in a row, so that edges deposit a linearly
+  // growing area in the grid cells between the first and the last
+  check_ring({{0.3, 0.2}, {5.7, 1.6}, {2.2, 4.9}});
+
+  // Edges whose part in a row spans exactly two grid cells
+  check_ring({{0.5, 0.0}, {1.5, 1.0}, {0.5, 2.0}});
+
+  // Inside a single grid cell
+  check_ring({{3.1, 3.2}, {3.9, 3.4}, {3.3, 3.8}});
+}
+
+BOOST_AUTO_TEST_CASE(TestPolygonWithHole)
+{
+  const ring outer{{0.5, 0.5}, {5.5, 0.5}, {5.5, 4.5}, {0.5, 4.5}};
+  const ring hole{{1.25, 1.5}, {2.5, 3.75}, {4.75, 2.5}};
+  boost::multi_array<double, 2> area(boost::extents[lx][ly]);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      area[i][j] = clipped_area(outer, i, j) - clipped_area(hole, i, j);
+    }
+  }
+
+  // The hole counts negatively, whatever the orientations of the rings
+  for (const auto &o : {outer, reversed(outer)}) {
+    for (const auto &h : {hole, reversed(hole)}) {
+      check_areas(
+        rasterize({{o, false}, {h, true}}, 3.0, 2.0),
+        area,
+        3.0,
+        2.0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestWeightsAreSummed)
+{
+  // Two overlapping squares with different weights
+  const std::vector<region> regions{
+    {{{0.5, 0.5}, {2.5, 0.5}, {2.5, 2.5}, {0.5, 2.5}}, 3.0, 2.0},
+    {{{1.5, 1.5}, {1.5, 3.5}, {3.5, 3.5}, {3.5, 1.5}}, -5.0, 7.0}};
+  ExactCoverage coverage;
+  coverage.reset(lx, ly);
+  density rho;
+  std::vector<double> vertex_shifts;
+  refill(coverage, rho, regions, vertex_shifts);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      const double area_a = clipped_area(regions[0].r, i, j);
+      const double area_b = clipped_area(regions[1].r, i, j);
+      BOOST_CHECK_SMALL(
+        rho.num[i][j] - (3.0 * area_a - 5.0 * area_b),
+        tolerance);
+      BOOST_CHECK_SMALL(
+        rho.den[i][j] - (2.0 * area_a + 7.0 * area_b),
+        tolerance);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestTouchedCellsAreNotCovered)
+{
+  // A square that only touches the grid cells to its right along x = 2
+  const density rho = rasterize(
+    {{{{1.0, 1.0}, {2.0, 1.0}, {2.0, 2.0}, {1.0, 2.0}}, false}},
+    3.0,
+    2.0);
+  BOOST_CHECK_CLOSE(rho.num[1][1], 3.0, 1e-10);
+  BOOST_CHECK_CLOSE(rho.den[1][1], 2.0, 1e-10);
+  BOOST_CHECK_EQUAL(rho.num[2][1], 0.0);
+  BOOST_CHECK_EQUAL(rho.den[2][1], 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(TestIncrementalRefillMatchesFullRefill)
+{
+  std::vector<region> regions{
+    {{{0.25, 0.25}, {1.75, 0.25}, {1.75, 1.75}, {0.25, 1.75}}, 3.0, 2.0},
+    {{{1.0, 0.5}, {2.5, 0.5}, {1.5, 1.5}}, 1.0, 1.0},
+    {{{4.25, 0.25}, {5.75, 0.25}, {5.75, 1.25}, {4.25, 1.25}}, 2.0, 4.0},
+    {{{0.5, 3.0}, {2.0, 3.0}, {1.0, 4.5}}, 1.0, 2.0},
+    {{{3.0, 3.0}, {5.5, 3.0}, {5.5, 4.75}, {4.25, 3.5}, {3.0, 4.75}},
+     2.0,
+     1.0}};
+
+  // Move the vertices of a region by (dx, dy) and record the shift
+  const auto move = [&regions](
+                      std::vector<double> &vertex_shifts,
+                      const std::vector<std::size_t> &vertices,
+                      const std::size_t r,
+                      const double dx,
+                      const double dy) {
+    for (const std::size_t k : vertices) {
+      regions[r].r[k] = {regions[r].r[k].x() + dx, regions[r].r[k].y() + dy};
+    }
+    vertex_shifts[r] += std::hypot(dx, dy);
+  };
+
+  // Compare with a full refill. The grid cells in approx, {imin, jmin, imax,
+  // jmax}, may contain regions that moved by less than
+  // refill_displacement_tolerance and were not rasterized again. Elsewhere,
+  // the refills must agree up to rounding errors.
+  const auto check_against_full_refill =
+    [&](const density &rho, const std::array<double, 4> &approx) {
+      ExactCoverage full_coverage;
+      full_coverage.reset(lx, ly);
+      density full_rho;
+      std::vector<double> full_vertex_shifts;
+      refill(full_coverage, full_rho, regions, full_vertex_shifts);
+      for (unsigned int i = 0; i < lx; ++i) {
+        for (unsigned int j = 0; j < ly; ++j) {
+          BOOST_TEST_CONTEXT("grid cell " << i << ", " << j)
+          {
+            const bool is_approx = i >= approx[0] && i < approx[2] &&
+                                   j >= approx[1] && j < approx[3];
+            const double tol = is_approx ? 1e-2 : tolerance;
+            BOOST_CHECK_SMALL(rho.num[i][j] - full_rho.num[i][j], tol);
+            BOOST_CHECK_SMALL(rho.den[i][j] - full_rho.den[i][j], tol);
+          }
+        }
+      }
+    };
+
+  ExactCoverage coverage;
+  coverage.reset(lx, ly);
+  density rho;
+  std::vector<double> vertex_shifts;
+  refill(coverage, rho, regions, vertex_shifts);
+  BOOST_CHECK_EQUAL(coverage.n_regions(), regions.size());
+  check_against_full_refill(rho, {0.0, 0.0, 0.0, 0.0});
+
+  // Region 1 moves across region 0, and region 2 moves by less than the
+  // tolerance. Region 4 only moves a vertex inside its bounding box. The
+  // weights of all regions change. They are applied exactly, whether or not
+  // the region is rasterized again.
+  move(vertex_shifts, {0, 1, 2}, 1, 1.5, 1.0);
+  move(vertex_shifts, {0, 1, 2, 3}, 2, 4e-4, -3e-4);
+  move(vertex_shifts, {3}, 4, 0.0, 1.0);
+  for (auto &reg : regions) {
+    reg.w_num *= 1.5;
+    reg.w_den *= 0.75;
+  }
+  refill(coverage, rho, regions, vertex_shifts);
+  check_against_full_refill(rho, {4.0, 0.0, 6.0, 2.0});
+  BOOST_CHECK_EQUAL(vertex_shifts[1], 0.0);
+  BOOST_CHECK_EQUAL(vertex_shifts[4], 0.0);
+  BOOST_CHECK_CLOSE(vertex_shifts[2], 5e-4, 1e-8);
+
+  // The shifts of region 2 add up to more than the tolerance
+  move(vertex_shifts, {0, 1, 2, 3}, 2, 6e-4, 0.0);
+  refill(coverage, rho, regions, vertex_shifts);
+  check_against_full_refill(rho, {0.0, 0.0, 0.0, 0.0});
+  BOOST_CHECK_EQUAL(vertex_shifts[2], 0.0);
+
+  // A different number of regions rasterizes all of them
+  regions.pop_back();
+  refill(coverage, rho, regions, vertex_shifts);
+  BOOST_CHECK_EQUAL(coverage.n_regions(), regions.size());
+  check_against_full_refill(rho, {0.0, 0.0, 0.0, 0.0});
+}
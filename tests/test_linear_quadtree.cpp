@@ -0,0 +1,130 @@
+#define BOOST_TEST_MODULE LinearQuadtreeTest
+#include "linear_quadtree.hpp"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+namespace
+{
+
+const double root_x0 = -16.0, root_y0 = 0.0, side = 64.0;
+const unsigned int max_depth = 6, max_points = 9;
+
+// Points clustered around a few centres, so that the leaves have different
+// depths
+std::vector<std::array<double, 2>> random_points(
+  const std::size_t n,
+  std::mt19937 &gen)
+{
+  std::uniform_int_distribution<int> centre(0, 3);
+  std::normal_distribution<double> offset(0.0, 4.0);
+  const double cx[4] = {8.0, 30.0, 20.0, 0.0};
+  const double cy[4] = {10.0, 50.0, 32.0, 60.0};
+  std::vector<std::array<double, 2>> points(n);
+  for (auto &p : points) {
+    const int c = centre(gen);
+    p[0] = std::clamp(cx[c] + offset(gen), 0.0, 32.0);
+    p[1] = std::clamp(cy[c] + offset(gen), 0.0, 64.0);
+  }
+  return points;
+}
+
+std::vector<std::uint64_t> codes_of(
+  const LinearQuadtree &qt,
+  const std::vector<std::array<double, 2>> &points)
+{
+  std::vector<std::uint64_t> codes;
+  for (const auto &p : points) {
+    codes.push_back(qt.point_code(p[0], p[1]));
+  }
+  return codes;
+}
+
+std::vector<std::uint64_t> leaves_from_scratch(
+  const std::vector<std::array<double, 2>> &points)
+{
+  LinearQuadtree qt;
+  qt.reset(root_x0, root_y0, side, max_depth, max_points);
+  qt.update(codes_of(qt, points));
+  return qt.graded_leaves();
+}
+
+// Number of points in a node, counted by brute force
+std::size_t n_points_in(
+  const std::uint64_t node,
+  const std::vector<std::uint64_t> &codes)
+{
+  const unsigned int shift = 2 * (max_depth - LinearQuadtree::depth(node));
+  std::size_t n = 0;
+  for (const auto code : codes) {
+    n += ((code >> shift) == node);
+  }
+  return n;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestLeavesPartitionRootAndAreGraded)
+{
+  std::mt19937 gen(42);
+  const auto points = random_points(2000, gen);
+  LinearQuadtree qt;
+  qt.reset(root_x0, root_y0, side, max_depth, max_points);
+  qt.update(codes_of(qt, points));
+  const auto leaves = qt.graded_leaves();
+
+  // The leaves cover the root without overlap
+  double area = 0.0;
+  for (const auto leaf : leaves) {
+    const auto depth = static_cast<int>(LinearQuadtree::depth(leaf));
+    area += std::ldexp(1.0, -2 * depth);
+  }
+  BOOST_CHECK_EQUAL(area, 1.0);
+
+  // Leaves that share an edge differ in depth by at most one
+  for (const auto a : leaves) {
+    const auto ba = qt.bbox(a);
+    for (const auto b : leaves) {
+      const auto bb = qt.bbox(b);
+      const bool share_x_edge =
+        (ba[2] == bb[0] || ba[0] == bb[2]) && ba[1] < bb[3] && bb[1] < ba[3];
+      const bool share_y_edge =
+        (ba[3] == bb[1] || ba[1] == bb[3]) && ba[0] < bb[2] && bb[0] < ba[2];
+      if (share_x_edge || share_y_edge) {
+        const int da = static_cast<int>(LinearQuadtree::depth(a));
+        const int db = static_cast<int>(LinearQuadtree::depth(b));
+        BOOST_CHECK_LE(std::abs(da - db), 1);
+      }
+    }
+  }
+
+  // Leaves above the maximum depth are not overfull
+  const auto codes = codes_of(qt, points);
+  for (const auto leaf : leaves) {
+    if (LinearQuadtree::depth(leaf) < max_depth) {
+      BOOST_CHECK_LE(n_points_in(leaf, codes), max_points);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestIncrementalUpdateMatchesRebuild)
+{
+  std::mt19937 gen(7);
+  auto points = random_points(2000, gen);
+  LinearQuadtree qt;
+  qt.reset(root_x0, root_y0, side, max_depth, max_points);
+  qt.update(codes_of(qt, points));
+
+  // Move the points by decreasing amounts, as in successive integrations
+  for (const double step : {8.0, 2.0, 0.5, 0.1}) {
+    std::normal_distribution<double> move(0.0, step);
+    for (auto &p : points) {
+      p[0] = std::clamp(p[0] + move(gen), 0.0, 32.0);
+      p[1] = std::clamp(p[1] + move(gen), 0.0, 64.0);
+    }
+    qt.update(codes_of(qt, points));
+    BOOST_CHECK(qt.graded_leaves() == leaves_from_scratch(points));
+  }
+
+  // Without any movement, no leaf changes
+  BOOST_CHECK_EQUAL(qt.update(codes_of(qt, points)), 0);
+}
@@ -0,0 +1,73 @@
+#define BOOST_TEST_MODULE PaddedGridTest
+#include "grid_sampling.hpp"
+#include "interpolate_bilinearly.hpp"
+#include "padded_grid.hpp"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+// Fill a PaddedGrid and a multi_array with the same random values
+static void fill_grids(
+  const unsigned int lx,
+  const unsigned int ly,
+  const char zero,
+  PaddedGrid &padded,
+  boost::multi_array<double, 2> &grid)
+{
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  padded.allocate(lx, ly, zero);
+  grid.resize(boost::extents[lx][ly]);
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      grid[i][j] = dist(gen);
+      padded(i, j) = grid[i][j];
+    }
+  }
+  padded.fill_ghost_cells();
+}
+
+BOOST_AUTO_TEST_CASE(TestScalarMatchesInterpolateBilinearly)
+{
+  const unsigned int lx = 16, ly = 8;
+  std::vector<double> x, y;
+  sample_points(lx, ly, x, y);
+  for (const char zero : {'x', 'y'}) {
+    PaddedGrid padded;
+    boost::multi_array<double, 2> grid;
+    fill_grids(lx, ly, zero, padded, grid);
+    for (std::size_t k = 0; k < x.size(); ++k) {
+      BOOST_CHECK_EQUAL(
+        padded.interpolate_bilinearly(x[k], y[k]),
+        interpolate_bilinearly(x[k], y[k], grid, zero, lx, ly));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestRowKernelsMatchScalar)
+{
+  const unsigned int lx = 32, ly = 64;
+  std::vector<double> x, y;
+  sample_points(lx, ly, x, y);
+
+  // Odd length to exercise the scalar remainder of the vectorized loops
+  x.push_back(lx / 3.0);
+  y.push_back(ly / 3.0);
+  const std::vector<SimdLevel> levels = supported_simd_levels();
+  for (const char zero : {'x', 'y'}) {
+    PaddedGrid padded;
+    boost::multi_array<double, 2> grid;
+    fill_grids(lx, ly, zero, padded, grid);
+    for (const SimdLevel level : levels) {
+      std::vector<double> out(x.size());
+      padded.interpolate_bilinearly(
+        x.data(),
+        y.data(),
+        x.size(),
+        out.data(),
+        level);
+      for (std::size_t k = 0; k < x.size(); ++k) {
+        BOOST_CHECK_EQUAL(out[k], padded.interpolate_bilinearly(x[k], y[k]));
+      }
+    }
+  }
+}
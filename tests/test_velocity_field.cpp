@@ -0,0 +1,104 @@
+#define BOOST_TEST_MODULE VelocityFieldTest
+#include "grid_sampling.hpp"
+#include "interpolate_bilinearly.hpp"
+#include "velocity_field.hpp"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+namespace
+{
+
+const unsigned int lx = 24, ly = 40;
+const double rho_mean = 1.5;
+
+// Random flux and density. The velocity grids at time t are computed in the
+// same way as calculate_velocity() used to compute them.
+struct Fixture {
+  VelocityField field;
+  boost::multi_array<double, 2> flux_x, flux_y, rho_init;
+
+  Fixture()
+      : flux_x(boost::extents[lx][ly]), flux_y(boost::extents[lx][ly]),
+        rho_init(boost::extents[lx][ly])
+  {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> flux(-1.0, 1.0);
+    std::uniform_real_distribution<double> rho(0.1, 3.0);
+    field.allocate(lx, ly);
+    field.set_rho_mean(rho_mean);
+    for (unsigned int i = 0; i < lx; ++i) {
+      for (unsigned int j = 0; j < ly; ++j) {
+        flux_x[i][j] = flux(gen);
+        flux_y[i][j] = flux(gen);
+        rho_init[i][j] = rho(gen);
+        field.flux_x(i, j) = flux_x[i][j];
+        field.flux_y(i, j) = flux_y[i][j];
+        field.rho_diff(i, j) = rho_init[i][j] - rho_mean;
+      }
+    }
+    field.fill_ghost_cells();
+  }
+
+  void velocity_grids(
+    const double t,
+    boost::multi_array<double, 2> &grid_vx,
+    boost::multi_array<double, 2> &grid_vy) const
+  {
+    grid_vx.resize(boost::extents[lx][ly]);
+    grid_vy.resize(boost::extents[lx][ly]);
+    for (unsigned int i = 0; i < lx; ++i) {
+      for (unsigned int j = 0; j < ly; ++j) {
+        double rho = rho_mean + (1.0 - t) * (rho_init[i][j] - rho_mean);
+        grid_vx[i][j] = -flux_x[i][j] / rho;
+        grid_vy[i][j] = -flux_y[i][j] / rho;
+      }
+    }
+  }
+};
+
+}  // namespace
+
+BOOST_FIXTURE_TEST_CASE(TestScalarMatchesVelocityGrid, Fixture)
+{
+  std::vector<double> x, y;
+  sample_points(lx, ly, x, y);
+  for (const double t : {0.0, 0.37, 1.0}) {
+    boost::multi_array<double, 2> grid_vx, grid_vy;
+    velocity_grids(t, grid_vx, grid_vy);
+    for (std::size_t k = 0; k < x.size(); ++k) {
+      double vx, vy;
+      field.velocity(x[k], y[k], t, vx, vy);
+      BOOST_CHECK_EQUAL(
+        vx,
+        interpolate_bilinearly(x[k], y[k], grid_vx, 'x', lx, ly));
+      BOOST_CHECK_EQUAL(
+        vy,
+        interpolate_bilinearly(x[k], y[k], grid_vy, 'y', lx, ly));
+    }
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(TestRowKernelsMatchScalar, Fixture)
+{
+  std::vector<double> x, y;
+  sample_points(lx, ly, x, y);
+  const std::vector<SimdLevel> levels = supported_simd_levels();
+  const double t = 0.61;
+  for (const SimdLevel level : levels) {
+    std::vector<double> vx(x.size()), vy(x.size());
+    field.velocity(
+      x.data(),
+      y.data(),
+      x.size(),
+      t,
+      vx.data(),
+      vy.data(),
+      level);
+    for (std::size_t k = 0; k < x.size(); ++k) {
+      double vx_scalar, vy_scalar;
+      field.velocity(x[k], y[k], t, vx_scalar, vy_scalar);
+      BOOST_CHECK_EQUAL(vx[k], vx_scalar);
+      BOOST_CHECK_EQUAL(vy[k], vy_scalar);
+    }
+  }
+}